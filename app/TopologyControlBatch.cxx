@@ -0,0 +1,599 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+// Run FixTopologyCarveOutside/FixTopologyCarveInside on all files listed in a manifest.
+//
+// Each manifest line holds whitespace separated columns (lines starting with '#' are skipped):
+//
+//   input  mask  output  radius  [outside|inside]
+//
+// where mask is '-' if the default (dilated/eroded) mask should be used. Inputs must have unsigned
+// char or unsigned short pixels, other pixel types are reported as errors instead of being converted.
+// Volumes are read ahead by a reader thread, while up to --jobs files are carved and written
+// concurrently. The reader only starts loading a file once its estimated memory fits into
+// --memory-budget. One JSON object with timings and voxel changes is appended to the stats file per
+// manifest entry.
+
+#include "itkFixTopologyCarveInside.h"
+#include "itkFixTopologyCarveOutside.h"
+
+#include "itkImageFileReader.h"
+#include "itkImageFileWriter.h"
+#include "itkImageIOFactory.h"
+#include "itkMetaImageIOFactory.h"
+#include "itkNiftiImageIOFactory.h"
+#include "itkNrrdImageIOFactory.h"
+#include "itkNumericTraits.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+constexpr unsigned int Dimension = 3;
+using MaskPixelType = unsigned char;
+using MaskType = itk::Image<MaskPixelType, Dimension>;
+using Clock = std::chrono::steady_clock;
+
+struct Settings
+{
+  unsigned int  jobs = 2;
+  size_t        memory_budget = size_t{ 4096 } << 20;
+  unsigned int  threads_per_job = 0;
+  unsigned long inside_value = 1;
+  bool          sparse = false;
+  bool          vectorized = false;
+};
+
+struct Job
+{
+  size_t       line = 0;
+  std::string  input;
+  std::string  mask;
+  std::string  output;
+  unsigned int radius = 1;
+  bool         inside = false;
+};
+
+/** A job whose volumes have been read (or failed to read). 'image' is an itk::Image of the pixel type
+ * given by 'component_type'. */
+struct LoadedJob
+{
+  Job                                job;
+  itk::ImageBase<Dimension>::Pointer image;
+  MaskType::Pointer                  mask;
+  itk::IOComponentEnum               component_type = itk::IOComponentEnum::UNKNOWNCOMPONENTTYPE;
+  size_t                             voxels = 0;
+  size_t                             reserved_bytes = 0;
+  double                             read_seconds = 0;
+  std::string                        error;
+};
+
+/** Estimated peak memory of one file, per voxel.
+ *
+ * Input, output, the padded state and the mask (if given) are alive while the file is processed. The dense
+ * path peaks while the signed Maurer distance map is computed, which holds its float output and two float
+ * temporaries (thresholded input and contour). The sparse state computes the distance per slab, there the
+ * peak is the default mask (dilation or erosion output and its temporary). Not included are the reader
+ * buffers of formats which need a conversion, and the changed voxel offsets (8 bytes per changed voxel). */
+template <typename TPixel>
+size_t
+BytesPerVoxel(const Job & job, const Settings & settings)
+{
+  const size_t images = 2 * sizeof(TPixel) + sizeof(MaskPixelType) + (job.mask.empty() ? 0 : sizeof(MaskPixelType));
+  const size_t distance_map = settings.sparse ? 0 : 3 * sizeof(float);
+  const size_t default_mask = job.mask.empty() ? 2 * sizeof(MaskPixelType) : 0;
+  return images + std::max(distance_map, default_mask);
+}
+
+double
+SecondsSince(Clock::time_point start)
+{
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+std::string
+JsonString(const std::string & s)
+{
+  std::ostringstream os;
+  os << '"';
+  for (const char c : s)
+  {
+    switch (c)
+    {
+      case '"':
+        os << "\\\"";
+        break;
+      case '\\':
+        os << "\\\\";
+        break;
+      case '\n':
+        os << "\\n";
+        break;
+      case '\t':
+        os << "\\t";
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20)
+        {
+          os << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec;
+        }
+        else
+        {
+          os << c;
+        }
+    }
+  }
+  os << '"';
+  return os.str();
+}
+
+/** Blocks callers until their reservation fits into the budget. A single reservation larger than
+ * the budget is granted once nothing else is reserved, so oversized files run alone. */
+class MemoryBudget
+{
+public:
+  explicit MemoryBudget(size_t total)
+    : m_Total(total)
+  {}
+
+  void
+  Acquire(size_t bytes)
+  {
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_Condition.wait(lock, [&] { return m_Used == 0 || m_Used + bytes <= m_Total; });
+    m_Used += bytes;
+  }
+
+  void
+  Release(size_t bytes)
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      m_Used -= bytes;
+    }
+    m_Condition.notify_all();
+  }
+
+private:
+  const size_t            m_Total;
+  size_t                  m_Used = 0;
+  std::mutex              m_Mutex;
+  std::condition_variable m_Condition;
+};
+
+/** Bounded hand-over from the reader to the workers */
+class LoadedQueue
+{
+public:
+  explicit LoadedQueue(size_t capacity)
+    : m_Capacity(capacity)
+  {}
+
+  void
+  Push(LoadedJob && item)
+  {
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_NotFull.wait(lock, [&] { return m_Items.size() < m_Capacity; });
+    m_Items.push_back(std::move(item));
+    m_NotEmpty.notify_one();
+  }
+
+  /** Returns false once the queue is closed and drained */
+  bool
+  Pop(LoadedJob & item)
+  {
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_NotEmpty.wait(lock, [&] { return !m_Items.empty() || m_Closed; });
+    if (m_Items.empty())
+      return false;
+    item = std::move(m_Items.front());
+    m_Items.pop_front();
+    m_NotFull.notify_one();
+    return true;
+  }
+
+  void
+  Close()
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Closed = true;
+    m_NotEmpty.notify_all();
+  }
+
+private:
+  const size_t            m_Capacity;
+  std::deque<LoadedJob>   m_Items;
+  bool                    m_Closed = false;
+  std::mutex              m_Mutex;
+  std::condition_variable m_NotFull;
+  std::condition_variable m_NotEmpty;
+};
+
+bool
+ReadManifest(const std::string & file_name, std::vector<Job> & jobs)
+{
+  std::ifstream file(file_name);
+  if (!file)
+  {
+    std::cerr << "Cannot open manifest " << file_name << std::endl;
+    return false;
+  }
+
+  std::string line;
+  for (size_t line_number = 1; std::getline(file, line); ++line_number)
+  {
+    const auto first = line.find_first_not_of(" \t\r");
+    if (first == std::string::npos || line[first] == '#')
+      continue;
+
+    std::istringstream columns(line);
+    Job                job;
+    std::string        mode = "outside";
+    job.line = line_number;
+    if (!(columns >> job.input >> job.mask >> job.output >> job.radius))
+    {
+      std::cerr << file_name << ":" << line_number << ": expected 'input mask output radius [outside|inside]'"
+                << std::endl;
+      return false;
+    }
+    columns >> mode;
+    if (mode != "outside" && mode != "inside")
+    {
+      std::cerr << file_name << ":" << line_number << ": unknown mode '" << mode << "'" << std::endl;
+      return false;
+    }
+    job.inside = (mode == "inside");
+    if (job.mask == "-")
+      job.mask.clear();
+    jobs.push_back(job);
+  }
+  return true;
+}
+
+/** Reads the header of 'file_name', throws unless the pixels are unsigned char or unsigned short scalars */
+itk::ImageIOBase::Pointer
+ReadImageInformation(const std::string & file_name)
+{
+  auto io = itk::ImageIOFactory::CreateImageIO(file_name.c_str(), itk::ImageIOFactory::IOFileModeEnum::ReadMode);
+  if (!io)
+  {
+    itkGenericExceptionMacro("Could not create ImageIO for " << file_name);
+  }
+  io->SetFileName(file_name);
+  io->ReadImageInformation();
+
+  const auto component_type = io->GetComponentType();
+  if (io->GetNumberOfComponents() != 1 ||
+      (component_type != itk::IOComponentEnum::UCHAR && component_type != itk::IOComponentEnum::USHORT))
+  {
+    itkGenericExceptionMacro("Unsupported pixel type "
+                             << itk::ImageIOBase::GetPixelTypeAsString(io->GetPixelType()) << " of "
+                             << itk::ImageIOBase::GetComponentTypeAsString(component_type) << " in " << file_name
+                             << ", expected unsigned char or unsigned short scalars");
+  }
+  return io;
+}
+
+template <typename TPixel>
+void
+ReadVolumes(LoadedJob & loaded, const Settings & settings, MemoryBudget & budget)
+{
+  using ImageType = itk::Image<TPixel, Dimension>;
+
+  const Job & job = loaded.job;
+  if (settings.inside_value > itk::NumericTraits<TPixel>::max())
+  {
+    itkGenericExceptionMacro("Inside value " << settings.inside_value << " exceeds the pixel type of " << job.input);
+  }
+
+  loaded.reserved_bytes = loaded.voxels * BytesPerVoxel<TPixel>(job, settings);
+  budget.Acquire(loaded.reserved_bytes);
+
+  const auto start = Clock::now();
+  loaded.image = itk::ReadImage<ImageType>(job.input).GetPointer();
+  if (!job.mask.empty())
+  {
+    loaded.mask = itk::ReadImage<MaskType>(job.mask);
+  }
+  loaded.read_seconds = SecondsSince(start);
+}
+
+/** Reads the volumes of all jobs in manifest order, ahead of the workers */
+void
+ReadAll(const std::vector<Job> & jobs, const Settings & settings, MemoryBudget & budget, LoadedQueue & queue)
+{
+  for (const auto & job : jobs)
+  {
+    LoadedJob loaded;
+    loaded.job = job;
+    try
+    {
+      const auto io = ReadImageInformation(job.input);
+      loaded.voxels = io->GetImageSizeInPixels();
+      loaded.component_type = io->GetComponentType();
+      if (loaded.component_type == itk::IOComponentEnum::UCHAR)
+        ReadVolumes<unsigned char>(loaded, settings, budget);
+      else
+        ReadVolumes<unsigned short>(loaded, settings, budget);
+    }
+    catch (const std::exception & e)
+    {
+      loaded.error = e.what();
+      loaded.image = nullptr;
+      loaded.mask = nullptr;
+    }
+    queue.Push(std::move(loaded));
+  }
+  queue.Close();
+}
+
+/** Timings and voxel changes of one processed file */
+struct Result
+{
+  double process_seconds = 0;
+  double write_seconds = 0;
+  size_t added = 0;
+  size_t removed = 0;
+};
+
+template <typename TPixel>
+Result
+CarveAndWrite(const LoadedJob & loaded, const Settings & settings)
+{
+  using ImageType = itk::Image<TPixel, Dimension>;
+  using FilterType = itk::FixTopologyBase<ImageType, ImageType, MaskType>;
+
+  const Job & job = loaded.job;
+  Result      result;
+  auto        start = Clock::now();
+
+  typename FilterType::Pointer filter;
+  if (job.inside)
+    filter = itk::FixTopologyCarveInside<ImageType, ImageType, MaskType>::New().GetPointer();
+  else
+    filter = itk::FixTopologyCarveOutside<ImageType, ImageType, MaskType>::New().GetPointer();
+  filter->SetInput(static_cast<const ImageType *>(loaded.image.GetPointer()));
+  filter->SetNumberOfWorkUnits(settings.threads_per_job);
+  filter->SetMaskImage(loaded.mask);
+  filter->SetRadius(job.radius);
+  filter->SetInsideValue(static_cast<TPixel>(settings.inside_value));
+  filter->SetUseSparseState(settings.sparse);
+  filter->SetUseVectorizedClassification(settings.vectorized);
+  filter->ComputeChangedVoxelsOn();
+  filter->Update();
+  result.process_seconds = SecondsSince(start);
+
+  // a changed voxel was added if it is foreground in the output (the input may hold other labels)
+  const TPixel * output = filter->GetOutput()->GetBufferPointer();
+  for (const auto offset : filter->GetChangedVoxels()->CastToSTLConstContainer())
+  {
+    if (output[offset] == settings.inside_value)
+      ++result.added;
+    else
+      ++result.removed;
+  }
+
+  start = Clock::now();
+  itk::WriteImage(filter->GetOutput(), job.output, true);
+  result.write_seconds = SecondsSince(start);
+  return result;
+}
+
+/** Carve and write one file, returns its stats line. Failures are recorded in loaded.error. */
+std::string
+Process(LoadedJob & loaded, const Settings & settings)
+{
+  const Job & job = loaded.job;
+  Result      result;
+
+  if (loaded.error.empty())
+  {
+    try
+    {
+      if (loaded.component_type == itk::IOComponentEnum::UCHAR)
+        result = CarveAndWrite<unsigned char>(loaded, settings);
+      else
+        result = CarveAndWrite<unsigned short>(loaded, settings);
+    }
+    catch (const std::exception & e)
+    {
+      loaded.error = e.what();
+    }
+  }
+
+  std::ostringstream os;
+  os << "{\"line\": " << job.line << ", \"input\": " << JsonString(job.input)
+     << ", \"mask\": " << (job.mask.empty() ? std::string("null") : JsonString(job.mask))
+     << ", \"output\": " << JsonString(job.output) << ", \"mode\": \"" << (job.inside ? "inside" : "outside")
+     << "\", \"radius\": " << job.radius << ", \"status\": \"" << (loaded.error.empty() ? "ok" : "error") << "\"";
+  if (loaded.error.empty())
+  {
+    os << ", \"voxels\": " << loaded.voxels << ", \"added\": " << result.added << ", \"removed\": " << result.removed
+       << ", \"read_seconds\": " << loaded.read_seconds << ", \"process_seconds\": " << result.process_seconds
+       << ", \"write_seconds\": " << result.write_seconds;
+  }
+  else
+  {
+    os << ", \"error\": " << JsonString(loaded.error);
+  }
+  os << "}";
+  return os.str();
+}
+
+/** Parses a decimal number, the whole text must be a number not below 'min' */
+bool
+ParseNumber(const char * text, unsigned long min, unsigned long & value)
+{
+  char * end = nullptr;
+  errno = 0;
+  value = std::strtoul(text, &end, 10);
+  return end != text && *end == '\0' && errno == 0 && text[0] != '-' && value >= min;
+}
+
+void
+PrintUsage(const char * name)
+{
+  std::cerr << "Usage: " << name << " manifest stats.jsonl [options]\n"
+            << "\n"
+            << "Manifest lines: input mask output radius [outside|inside] (mask '-' for the default mask)\n"
+            << "Inputs: MetaImage, NIfTI or NRRD files with unsigned char or unsigned short pixels\n"
+            << "\n"
+            << "Options:\n"
+            << "  --jobs N             files processed concurrently (default: 2)\n"
+            << "  --memory-budget MB   estimated memory for files in flight, including read-ahead (default: 4096)\n"
+            << "  --threads-per-job N  ITK work units per file (default: hardware threads / jobs)\n"
+            << "  --inside-value V     foreground label of the inputs (default: 1)\n"
+            << "  --sparse             carve on the sparse block grid (UseSparseState)\n"
+            << "  --vectorized         batched simple point tests (UseVectorizedClassification)\n";
+}
+} // namespace
+
+int
+main(int argc, char * argv[])
+{
+  if (argc < 3)
+  {
+    PrintUsage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  const std::string manifest = argv[1];
+  const std::string stats_file_name = argv[2];
+
+  Settings settings;
+  for (int i = 3; i < argc; ++i)
+  {
+    const std::string arg = argv[i];
+    const bool        has_value = (i + 1 < argc);
+    unsigned long     value = 0;
+    bool              valid = true;
+    if (arg == "--jobs" && has_value)
+    {
+      valid = ParseNumber(argv[++i], 1, value);
+      settings.jobs = static_cast<unsigned int>(value);
+    }
+    else if (arg == "--memory-budget" && has_value)
+    {
+      valid = ParseNumber(argv[++i], 1, value);
+      settings.memory_budget = static_cast<size_t>(value) << 20;
+    }
+    else if (arg == "--threads-per-job" && has_value)
+    {
+      valid = ParseNumber(argv[++i], 1, value);
+      settings.threads_per_job = static_cast<unsigned int>(value);
+    }
+    else if (arg == "--inside-value" && has_value)
+    {
+      valid = ParseNumber(argv[++i], 0, value);
+      settings.inside_value = value;
+    }
+    else if (arg == "--sparse")
+      settings.sparse = true;
+    else if (arg == "--vectorized")
+      settings.vectorized = true;
+    else
+    {
+      std::cerr << "Unknown option " << arg << "\n";
+      PrintUsage(argv[0]);
+      return EXIT_FAILURE;
+    }
+
+    if (!valid)
+    {
+      std::cerr << "Invalid value " << argv[i] << " for " << arg << "\n";
+      PrintUsage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  // the tool does not use the IO factory registration of UseITK, so the supported formats are registered here
+  itk::MetaImageIOFactory::RegisterOneFactory();
+  itk::NiftiImageIOFactory::RegisterOneFactory();
+  itk::NrrdImageIOFactory::RegisterOneFactory();
+
+  std::vector<Job> jobs;
+  if (!ReadManifest(manifest, jobs))
+  {
+    return EXIT_FAILURE;
+  }
+
+  std::ofstream stats(stats_file_name);
+  if (!stats)
+  {
+    std::cerr << "Cannot write " << stats_file_name << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // the files are the unit of parallelism, each filter only gets its share of the cores as work units,
+  // while the global thread pool keeps its size so the concurrent filters do not wait for each other
+  if (settings.threads_per_job == 0)
+  {
+    settings.threads_per_job = std::max(1u, std::thread::hardware_concurrency() / settings.jobs);
+  }
+
+  MemoryBudget budget(settings.memory_budget);
+  LoadedQueue  loaded_queue(settings.jobs);
+  std::mutex   stats_mutex;
+  size_t       num_failed = 0;
+
+  std::thread reader([&] { ReadAll(jobs, settings, budget, loaded_queue); });
+
+  std::vector<std::thread> workers;
+  for (unsigned int w = 0; w < settings.jobs; ++w)
+  {
+    workers.emplace_back([&] {
+      LoadedJob loaded;
+      while (loaded_queue.Pop(loaded))
+      {
+        const std::string line = Process(loaded, settings);
+        const bool        failed = !loaded.error.empty();
+
+        // free the volumes before the reader can claim their memory
+        const size_t reserved = loaded.reserved_bytes;
+        loaded = LoadedJob();
+        budget.Release(reserved);
+
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        stats << line << std::endl;
+        num_failed += failed ? 1 : 0;
+      }
+    });
+  }
+
+  reader.join();
+  for (auto & worker : workers)
+  {
+    worker.join();
+  }
+
+  std::cout << jobs.size() - num_failed << " of " << jobs.size() << " files processed" << std::endl;
+  return num_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
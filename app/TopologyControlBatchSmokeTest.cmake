@@ -0,0 +1,78 @@
+# Runs TopologyControlBatch on a two line manifest and checks the stats file.
+#
+#   cmake -DTOPOLOGY_CONTROL_BATCH=<executable> -DWORK_DIR=<directory> -P TopologyControlBatchSmokeTest.cmake
+#
+# The inputs are 12x12x7 MetaImages (ASCII data) with a plane at z = 3 and a single voxel hole at (6, 6, 3),
+# which is closed by FixTopologyCarveOutside with radius 1. The unsigned short input additionally holds the
+# label 257 at (0, 0, 0), which must not be mistaken for foreground.
+
+if(NOT TOPOLOGY_CONTROL_BATCH OR NOT WORK_DIR)
+  message(FATAL_ERROR "TOPOLOGY_CONTROL_BATCH and WORK_DIR are required")
+endif()
+
+file(REMOVE_RECURSE "${WORK_DIR}")
+file(MAKE_DIRECTORY "${WORK_DIR}")
+
+function(write_plane_with_hole file_name element_type first_value)
+  set(data "")
+  foreach(z RANGE 6)
+    foreach(y RANGE 11)
+      set(row "")
+      foreach(x RANGE 11)
+        set(value 0)
+        if(z EQUAL 3 AND NOT (x EQUAL 6 AND y EQUAL 6))
+          set(value 1)
+        elseif(z EQUAL 0 AND y EQUAL 0 AND x EQUAL 0)
+          set(value ${first_value})
+        endif()
+        string(APPEND row " ${value}")
+      endforeach()
+      string(APPEND data "${row}\n")
+    endforeach()
+  endforeach()
+
+  file(WRITE "${file_name}"
+    "ObjectType = Image\n"
+    "NDims = 3\n"
+    "DimSize = 12 12 7\n"
+    "ElementSpacing = 1 1 1\n"
+    "BinaryData = False\n"
+    "ElementType = ${element_type}\n"
+    "ElementDataFile = LOCAL\n"
+    "${data}")
+endfunction()
+
+write_plane_with_hole("${WORK_DIR}/plane_uc.mha" MET_UCHAR 0)
+write_plane_with_hole("${WORK_DIR}/plane_us.mha" MET_USHORT 257)
+
+file(WRITE "${WORK_DIR}/manifest.txt"
+  "${WORK_DIR}/plane_uc.mha - ${WORK_DIR}/closed_uc.mha 1 outside\n"
+  "${WORK_DIR}/plane_us.mha - ${WORK_DIR}/closed_us.mha 1 outside\n")
+
+execute_process(
+  COMMAND "${TOPOLOGY_CONTROL_BATCH}" "${WORK_DIR}/manifest.txt" "${WORK_DIR}/stats.jsonl" --jobs 2
+  RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+  message(FATAL_ERROR "TopologyControlBatch failed with ${result}")
+endif()
+
+file(STRINGS "${WORK_DIR}/stats.jsonl" lines)
+list(LENGTH lines num_lines)
+if(NOT num_lines EQUAL 2)
+  message(FATAL_ERROR "Expected 2 lines in stats.jsonl, got ${num_lines}")
+endif()
+
+foreach(line IN LISTS lines)
+  foreach(field "\"status\": \"ok\"" "\"voxels\": 1008" "\"added\": 1," "\"removed\": 0,")
+    string(FIND "${line}" "${field}" position)
+    if(position EQUAL -1)
+      message(FATAL_ERROR "Missing ${field} in ${line}")
+    endif()
+  endforeach()
+endforeach()
+
+foreach(output closed_uc.mha closed_us.mha)
+  if(NOT EXISTS "${WORK_DIR}/${output}")
+    message(FATAL_ERROR "${output} was not written")
+  endif()
+endforeach()
@@ -0,0 +1,189 @@
+/// \file TopologyInvariants2D.h
+///
+/// Simple point tests on the 3x3 neighborhood of a pixel, the 2D counterpart of TopologyInvariants.h.
+///
+/// The tests are evaluated once for all 256 configurations of the 8 neighbors and stored in a table.
+/// Bit k of a configuration is set if neighbor n is foreground, with n = k for k < 4 and n = k + 1
+/// otherwise (x running fastest, as in itk::Neighborhood, skipping the center).
+
+#pragma once
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+namespace topology
+{
+
+/** \brief True if Euler characteristic of pixel set does not change (2D version of EulerInvariant)
+ */
+template <typename TNeighborhood, typename TLabel>
+bool
+EulerInvariant2D(const TNeighborhood & neighbors, const TLabel label)
+{
+  // Count only the changes at the center pixel, see EulerInvariant
+  static constexpr int c = 9 / 2;
+
+  assert(neighbors[c] == label);
+
+  // Pixels - count center
+  const int P = 1;
+
+  // Edges - count edges around center pixel
+  const int E = (neighbors[c - 1] == label ? 1 : 0)    // -x
+                + (neighbors[c + 1] == label ? 1 : 0)  // +x
+                + (neighbors[c - 3] == label ? 1 : 0)  // -y
+                + (neighbors[c + 3] == label ? 1 : 0); // +y
+
+  // Vertices - count verts around center pixel
+  int V = 0;
+  {
+    static const short offsets[4][2] = { { -1, -3 }, { +1, -3 }, { -1, +3 }, { +1, +3 } };
+    for (int i = 0; i < 4; i++)
+    {
+      short x = offsets[i][0];
+      short y = offsets[i][1];
+
+      V += (neighbors[c + x] == label && neighbors[c + y] == label && neighbors[c + x + y] == label) ? 1 : 0;
+    }
+  }
+
+  return (V - E + P) == 0;
+}
+
+/** \brief Returns the number of (edge) connected components for selected label in the 3x3 neighborhood
+ */
+template <typename TNeighborhood, typename TLabel>
+unsigned
+ConnectedComponents2D(const TNeighborhood & neighbors, const TLabel label)
+{
+  std::array<unsigned, 9> stack;
+  std::array<bool, 9>     visited;
+  visited.fill(false);
+
+  unsigned new_label = 0;
+  for (unsigned n = 0; n < 9; ++n)
+  {
+    // skip other labels and visited pixels
+    if (neighbors[n] != label || visited[n])
+      continue;
+
+    unsigned top = 0;
+    stack[top++] = n;
+    visited[n] = true;
+    new_label++;
+
+    while (top > 0)
+    {
+      const unsigned id = stack[--top];
+      const unsigned i = id % 3;
+      const unsigned j = id / 3;
+
+      const auto visit = [&](unsigned other) {
+        if (neighbors[other] == label && !visited[other])
+        {
+          stack[top++] = other;
+          visited[other] = true;
+        }
+      };
+      if (i < 2) // +x
+        visit(id + 1);
+      if (i > 0) // -x
+        visit(id - 1);
+      if (j < 2) // +y
+        visit(id + 3);
+      if (j > 0) // -y
+        visit(id - 3);
+    }
+  }
+
+  return new_label;
+}
+
+/** \brief True if number of connected components of pixel set does not change (2D version of CCInvariant)
+ */
+template <typename TNeighborhood, typename TLabel>
+bool
+CCInvariant2D(TNeighborhood neighbors, const TLabel label)
+{
+  neighbors[9 / 2] = 1;
+  unsigned cc_before = ConnectedComponents2D(neighbors, label);
+
+  neighbors[9 / 2] = 0;
+  unsigned cc_after = ConnectedComponents2D(neighbors, label);
+  return (cc_before == cc_after);
+}
+
+/** \brief Pack 3x3 neighborhood into 8 bits: bit k is set if the k-th non-center neighbor == label
+ */
+template <typename TNeighborhood, typename TLabel>
+inline uint8_t
+PackNeighborhood2D(const TNeighborhood & neighbors, const TLabel label)
+{
+  uint8_t bits = 0;
+  for (unsigned n = 0, k = 0; n < 9; ++n)
+  {
+    if (n == 9 / 2)
+      continue;
+    bits |= (neighbors[n] == label) ? static_cast<uint8_t>(1u << k) : 0;
+    ++k;
+  }
+  return bits;
+}
+
+/** Flags stored in the simple point table */
+enum eSimplePoint2D : uint8_t
+{
+  kSimpleRemoval = 1,  ///< center can be removed from the foreground (carve outside)
+  kSimpleAddition = 2, ///< center can be added to the foreground (carve inside)
+};
+
+/** \brief Simple point flags for all 256 configurations of the 8 foreground neighbors.
+ *
+ * Same tests as the 3D filters: removal keeps the Euler characteristic and number of components of
+ * foreground and background, addition keeps the Euler characteristic and components of the background.
+ */
+inline const std::array<uint8_t, 256> &
+SimplePointTable2D()
+{
+  static const std::array<uint8_t, 256> table = [] {
+    std::array<uint8_t, 256> t;
+    for (unsigned config = 0; config < 256; ++config)
+    {
+      std::array<unsigned char, 9> vals;
+      for (unsigned n = 0, k = 0; n < 9; ++n)
+      {
+        vals[n] = (n == 9 / 2) ? 0 : static_cast<unsigned char>((config >> k++) & 1);
+      }
+
+      // removal: center is foreground before
+      vals[9 / 2] = 1;
+      const bool removal = EulerInvariant2D(vals, 1) && CCInvariant2D(vals, 1) && CCInvariant2D(vals, 0);
+
+      // addition: center is background before
+      vals[9 / 2] = 0;
+      const bool addition = EulerInvariant2D(vals, 0) && CCInvariant2D(vals, 0);
+
+      t[config] = static_cast<uint8_t>((removal ? kSimpleRemoval : 0) | (addition ? kSimpleAddition : 0));
+    }
+    return t;
+  }();
+  return table;
+}
+
+/** \brief Batched table lookup: simple[i] is 1 if 'flag' is set for the packed configuration configs[i]
+ *
+ * Same interface as the batched 3D tests in TopologyInvariantsBatch.h.
+ */
+inline void
+ClassifySimplePoints2D(const uint32_t * configs, size_t count, uint8_t * simple, eSimplePoint2D flag)
+{
+  const auto & table = SimplePointTable2D();
+  for (size_t i = 0; i < count; ++i)
+  {
+    simple[i] = (table[configs[i] & 0xff] & flag) ? 1 : 0;
+  }
+}
+
+} // namespace topology
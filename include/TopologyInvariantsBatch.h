@@ -0,0 +1,320 @@
+/// \file TopologyInvariantsBatch.h
+///
+/// Batched simple point tests on 3x3x3 configurations packed into 27 bits.
+///
+/// Bit n of a configuration is set if neighbor n (x running fastest, as in
+/// itk::Neighborhood) is foreground. The center bit is ignored. The tests are
+/// equivalent to the ones in TopologyInvariants.h, but only use bitwise logic,
+/// so several configurations can be classified at once in SIMD registers.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define ITK_TOPOLOGY_HAVE_VECTOR_EXTENSIONS 1
+#  define ITK_TOPOLOGY_FORCE_INLINE __attribute__((always_inline)) inline
+#else
+#  define ITK_TOPOLOGY_HAVE_VECTOR_EXTENSIONS 0
+#  define ITK_TOPOLOGY_FORCE_INLINE inline
+#endif
+
+namespace topology
+{
+
+/** \brief Pack neighborhood into 27 bits: bit n is set if neighbors[n] == label
+ */
+template <typename TNeighborhood, typename TLabel>
+inline uint32_t
+PackNeighborhood(const TNeighborhood & neighbors, const TLabel label)
+{
+  uint32_t bits = 0;
+  for (unsigned n = 0; n < 27; ++n)
+  {
+    bits |= (neighbors[n] == label) ? (uint32_t{ 1 } << n) : 0;
+  }
+  return bits;
+}
+
+namespace detail
+{
+static constexpr unsigned kCenter = 27 / 2;
+static constexpr uint32_t kCenterBit = uint32_t{ 1 } << kCenter;
+static constexpr uint32_t kAllBits = (uint32_t{ 1 } << 27) - 1;
+
+/** bits of the 3x3x3 block with coordinate 'axis' in [lo, hi] */
+constexpr uint32_t
+SliceBits(unsigned axis, unsigned lo, unsigned hi)
+{
+  uint32_t bits = 0;
+  for (unsigned n = 0; n < 27; ++n)
+  {
+    const unsigned c = (axis == 0) ? n % 3 : (axis == 1) ? (n / 3) % 3 : n / 9;
+    bits |= (c >= lo && c <= hi) ? (uint32_t{ 1 } << n) : 0;
+  }
+  return bits;
+}
+
+static constexpr uint32_t kX12 = SliceBits(0, 1, 2);
+static constexpr uint32_t kX01 = SliceBits(0, 0, 1);
+static constexpr uint32_t kY12 = SliceBits(1, 1, 2);
+static constexpr uint32_t kY01 = SliceBits(1, 0, 1);
+static constexpr uint32_t kFaceBits = (kCenterBit >> 1) | (kCenterBit << 1) | (kCenterBit >> 3) | (kCenterBit << 3) |
+                                      (kCenterBit >> 9) | (kCenterBit << 9);
+static constexpr unsigned kMaxFaceNeighborDistance = 12;
+
+// Note: vectors are passed by reference, passing AVX vectors by value from code compiled
+// without AVX support changes the ABI (-Wpsabi).
+
+/** Face (6-connected) dilation of a bit set inside the 3x3x3 block. Works for scalars and vectors. */
+template <typename V>
+ITK_TOPOLOGY_FORCE_INLINE void
+Dilate6(const V & x, V & out)
+{
+  out = x | ((x << 1) & kX12) | ((x >> 1) & kX01) | ((x << 3) & kY12) | ((x >> 3) & kY01) | ((x << 9) & kAllBits) |
+         (x >> 9);
+}
+
+/** Same counts as EulerInvariant, returns V + F and E + P. Works for scalars and vectors. */
+template <typename V>
+ITK_TOPOLOGY_FORCE_INLINE void
+EulerTerms(const V & b, V & positive, V & negative)
+{
+  static constexpr unsigned c = kCenter;
+  static constexpr unsigned faces[6] = { c - 1, c + 1, c - 3, c + 3, c - 9, c + 9 };
+  static constexpr int      edges[12][2] = { { -1, -3 }, { +1, -3 }, { -1, +3 }, { +1, +3 }, { -1, -9 }, { +1, -9 },
+                                        { -1, +9 }, { +1, +9 }, { -3, -9 }, { +3, -9 }, { -3, +9 }, { +3, +9 } };
+  static constexpr int      verts[8][3] = { { -1, -3, -9 }, { +1, -3, -9 }, { -1, +3, -9 }, { +1, +3, -9 },
+                                       { -1, -3, +9 }, { +1, -3, +9 }, { -1, +3, +9 }, { +1, +3, +9 } };
+
+  V F = (b >> faces[0]) & 1;
+  for (unsigned i = 1; i < 6; ++i)
+  {
+    F += (b >> faces[i]) & 1;
+  }
+
+  V E = (b >> (c + edges[0][0])) & (b >> (c + edges[0][1])) & (b >> (c + edges[0][0] + edges[0][1])) & 1;
+  for (unsigned i = 1; i < 12; ++i)
+  {
+    const int o = edges[i][0];
+    const int u = edges[i][1];
+    E += (b >> (c + o)) & (b >> (c + u)) & (b >> (c + o + u)) & 1;
+  }
+
+  V Vx = b & 0;
+  for (unsigned i = 0; i < 8; ++i)
+  {
+    const int x = verts[i][0];
+    const int y = verts[i][1];
+    const int z = verts[i][2];
+    Vx += (b >> (c + x)) & (b >> (c + y)) & (b >> (c + z)) & (b >> (c + x + y)) & (b >> (c + x + z)) &
+          (b >> (c + y + z)) & (b >> (c + x + y + z)) & 1;
+  }
+
+  positive = Vx + F;
+  negative = E + 1;
+}
+
+/** Number of 6-connected components of a bit set */
+inline unsigned
+ConnectedComponentsBits(uint32_t set)
+{
+  unsigned count = 0;
+  while (set)
+  {
+    uint32_t comp = set & (~set + 1);
+    uint32_t next;
+    Dilate6(comp, next);
+    next &= set;
+    while (next != comp)
+    {
+      comp = next;
+      Dilate6(comp, next);
+      next &= set;
+    }
+    set &= ~comp;
+    ++count;
+  }
+  return count;
+}
+} // namespace detail
+
+/** \brief Bit version of EulerInvariant: 'bits' is the set of voxels with the tested label
+ */
+inline bool
+EulerInvariantBits(uint32_t bits)
+{
+  uint32_t positive, negative;
+  detail::EulerTerms(bits, positive, negative);
+  return positive == negative;
+}
+
+/** \brief Bit version of CCInvariant: 'bits' is the set of voxels with the tested label
+ */
+inline bool
+CCInvariantBits(uint32_t bits)
+{
+  return detail::ConnectedComponentsBits((bits | detail::kCenterBit) & detail::kAllBits) ==
+         detail::ConnectedComponentsBits(bits & detail::kAllBits & ~detail::kCenterBit);
+}
+
+/** \brief Can the center be removed from the foreground 'bits' without changing topology? (carve outside)
+ */
+inline bool
+IsSimpleForegroundRemoval(uint32_t bits)
+{
+  const uint32_t background = ~bits & detail::kAllBits;
+  return EulerInvariantBits(bits) && CCInvariantBits(bits) && CCInvariantBits(background);
+}
+
+/** \brief Can the center be added to the foreground 'bits' without changing topology? (carve inside)
+ */
+inline bool
+IsSimpleForegroundAddition(uint32_t bits)
+{
+  const uint32_t background = ~bits & detail::kAllBits;
+  return EulerInvariantBits(background) && CCInvariantBits(background);
+}
+
+namespace detail
+{
+inline void
+ClassifyScalar(const uint32_t * configs, size_t count, uint8_t * simple, bool removal)
+{
+  for (size_t i = 0; i < count; ++i)
+  {
+    simple[i] = removal ? IsSimpleForegroundRemoval(configs[i]) : IsSimpleForegroundAddition(configs[i]);
+  }
+}
+
+#if ITK_TOPOLOGY_HAVE_VECTOR_EXTENSIONS
+typedef uint32_t Vec4 __attribute__((vector_size(16)));
+typedef uint32_t Vec8 __attribute__((vector_size(32)));
+
+/** CCInvariant for each lane, without data dependent branches.
+ *
+ * Setting the center merges the components of 'bits' which contain a face neighbor of the center, so the
+ * number of components is invariant iff exactly one component contains face neighbors. This component is
+ * flood filled from the first face neighbor for a fixed number of steps. kMaxFaceNeighborDistance is the
+ * largest distance from the first face neighbor to another one in the same component, over all 2^26
+ * configurations (checked by itkTopologyInvariantsExhaustiveTest). */
+template <typename V>
+ITK_TOPOLOGY_FORCE_INLINE void
+CCInvariantLanes(const V & bits, V & result)
+{
+  const V set = bits & (kAllBits & ~kCenterBit);
+  const V faces = set & kFaceBits;
+  V       comp = faces & (~faces + 1);
+  for (unsigned i = 0; i < kMaxFaceNeighborDistance; ++i)
+  {
+    V next;
+    Dilate6(comp, next);
+    comp = next & set;
+  }
+  result = (V)((comp & faces) == faces) & (V)(faces != 0);
+}
+
+template <typename V>
+ITK_TOPOLOGY_FORCE_INLINE void
+EulerInvariantLanes(const V & bits, V & result)
+{
+  V positive, negative;
+  EulerTerms(bits, positive, negative);
+  result = (V)(positive == negative);
+}
+
+template <typename V>
+ITK_TOPOLOGY_FORCE_INLINE void
+ClassifyLanes(const uint32_t * configs, size_t count, uint8_t * simple, bool removal)
+{
+  static constexpr size_t lanes = sizeof(V) / sizeof(uint32_t);
+
+  size_t i = 0;
+  for (; i < count; i += lanes)
+  {
+    // the tail is padded with empty configurations
+    V bits = {};
+    std::memcpy(&bits, configs + i, sizeof(uint32_t) * (count - i < lanes ? count - i : lanes));
+
+    const V background = ~bits & kAllBits;
+    V       euler, cc;
+    if (removal)
+    {
+      V cc_background;
+      EulerInvariantLanes(bits, euler);
+      CCInvariantLanes(bits, cc);
+      CCInvariantLanes(background, cc_background);
+      cc &= cc_background;
+    }
+    else
+    {
+      EulerInvariantLanes(background, euler);
+      CCInvariantLanes(background, cc);
+    }
+    const V result = euler & cc;
+
+    for (size_t k = 0; k < lanes && i + k < count; ++k)
+    {
+      simple[i + k] = result[k] ? 1 : 0;
+    }
+  }
+}
+
+inline void
+ClassifySSE2(const uint32_t * configs, size_t count, uint8_t * simple, bool removal)
+{
+  ClassifyLanes<Vec4>(configs, count, simple, removal);
+}
+
+__attribute__((target("avx2"))) inline void
+ClassifyAVX2(const uint32_t * configs, size_t count, uint8_t * simple, bool removal)
+{
+  ClassifyLanes<Vec8>(configs, count, simple, removal);
+}
+#endif
+
+using ClassifyFunction = void (*)(const uint32_t *, size_t, uint8_t *, bool);
+
+/** Widest kernel supported by the CPU, selected once at runtime */
+inline ClassifyFunction
+SelectClassifyFunction()
+{
+#if ITK_TOPOLOGY_HAVE_VECTOR_EXTENSIONS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+  {
+    return &ClassifyAVX2;
+  }
+  return &ClassifySSE2;
+#else
+  return &ClassifyScalar;
+#endif
+}
+
+inline ClassifyFunction
+GetClassifyFunction()
+{
+  static const ClassifyFunction function = SelectClassifyFunction();
+  return function;
+}
+} // namespace detail
+
+/** \brief Batched IsSimpleForegroundRemoval: simple[i] = IsSimpleForegroundRemoval(configs[i])
+ */
+inline void
+ClassifyForegroundRemoval(const uint32_t * configs, size_t count, uint8_t * simple)
+{
+  detail::GetClassifyFunction()(configs, count, simple, true);
+}
+
+/** \brief Batched IsSimpleForegroundAddition: simple[i] = IsSimpleForegroundAddition(configs[i])
+ */
+inline void
+ClassifyForegroundAddition(const uint32_t * configs, size_t count, uint8_t * simple)
+{
+  detail::GetClassifyFunction()(configs, count, simple, false);
+}
+
+} // namespace topology
@@ -19,9 +19,19 @@
 #ifndef itkFixTopologyBase_h
 #define itkFixTopologyBase_h
 
-#include "itkImageToImageFilter.h"
+#include "itkFixTopologyMaskInputBase.h"
 #include "itkProgressAccumulator.h"
-
+#include "itkProgressReporter.h"
+#include "itkSparseBlockGrid.h"
+#include "itkVectorContainer.h"
+#include "TopologyInvariants.h"
+#include "TopologyInvariants2D.h"
+#include "TopologyInvariantsBatch.h"
+
+#include <array>
+#include <cstdlib>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 
 namespace itk
@@ -30,11 +40,23 @@ namespace itk
  *
  * \brief Base class for morphological closing/opening with topology constraints
  *
+ * 2D and 3D images are supported. The simple point tests of TopologyInvariants.h are used in 3D, the
+ * table of TopologyInvariants2D.h in 2D.
+ *
+ * If no mask is set (SetMaskImage), the input mask is dilated (or eroded) by 'Radius'.
+ *
+ * Batch processing: many masks can be added with AddMaskImage, they are carved into a shared result.
+ * The input state and distance map are computed once, then the masks are marked and carved inside their
+ * own regions, so the per-mask cost scales with the mask size. Masks whose regions do not interact are
+ * processed concurrently. Overlapping (or adjacent) masks are marked together and carved as one region,
+ * so the result does not depend on the order of the masks. If batch masks are set, SetMaskImage and
+ * UseSparseState are ignored.
+ *
  * \author Bryn Lloyd
  * \ingroup TopologyControl
  */
 template <class TInputImage, class TOutputImage, class TMaskImage>
-class ITK_TEMPLATE_EXPORT FixTopologyBase : public ImageToImageFilter<TInputImage, TOutputImage>
+class ITK_TEMPLATE_EXPORT FixTopologyBase : public FixTopologyMaskInputBase<TInputImage, TOutputImage, TMaskImage>
 {
 public:
   ITK_DISALLOW_COPY_AND_MOVE(FixTopologyBase);
@@ -45,14 +67,16 @@ public:
 
   static const unsigned int ImageDimension = InputImageDimension;
 
+  static_assert(ImageDimension == 2 || ImageDimension == 3, "FixTopologyBase supports 2D and 3D images.");
+
   /** Standard class typedefs. */
   using Self = FixTopologyBase;
-  using Superclass = ImageToImageFilter<TInputImage, TOutputImage>;
+  using Superclass = FixTopologyMaskInputBase<TInputImage, TOutputImage, TMaskImage>;
   using Pointer = SmartPointer<Self>;
   using ConstPointer = SmartPointer<const Self>;
 
   /** Run-time type information (and related methods). */
-  itkTypeMacro(FixTopologyBase, ImageToImageFilter);
+  itkTypeMacro(FixTopologyBase, FixTopologyMaskInputBase);
 
   /** Type for input image. */
   using InputImageType = TInputImage;
@@ -78,11 +102,14 @@ public:
   /** Pointer Type for the mask image. */
   using MaskImageTypePointer = typename MaskImageType::Pointer;
 
-  /** Optional mask (if none is provided the input mask is dilated by 'Radius') */
-  void
-  SetMaskImage(const MaskImageType * mask);
-  const MaskImageType *
-  GetMaskImage() const;
+  /** Region type of the output image. */
+  using RegionType = typename OutputImageType::RegionType;
+
+  /** Type for the distance map which orders the carving */
+  using RealImageType = itk::Image<float, ImageDimension>;
+
+  /** Container for the linear offsets (into the output buffer) of changed voxels. */
+  using ChangedVoxelContainerType = VectorContainer<IdentifierType, IdentifierType>;
 
   itkSetMacro(Radius, SizeValueType);
   itkGetConstMacro(Radius, SizeValueType);
@@ -90,9 +117,38 @@ public:
   itkSetMacro(InsideValue, InputImagePixelType);
   itkGetConstMacro(InsideValue, InputImagePixelType);
 
+  /** Carve on a sparse block grid which only stores the blocks near the mask (default: false).
+   * The state is built block by block from the input (and the mask image), the default mask and the
+   * distance map are computed slab by slab for the stored blocks only. No dense state, default mask or
+   * float distance map is allocated, so the working memory scales with the blocks near the structure.
+   * The result has the same topology as the dense path, but voxels with equal distance may be visited
+   * in a different order. */
+  itkSetMacro(UseSparseState, bool);
+  itkGetConstMacro(UseSparseState, bool);
+  itkBooleanMacro(UseSparseState);
+
+  /** Classify voxels with equal distance in batches, using the bitwise simple point tests of
+   * TopologyInvariantsBatch.h (SSE2/AVX2 lanes where available, default: false). The result is
+   * topologically equivalent to the default path, but ties may be resolved differently. In 2D
+   * the batches are looked up in the table of TopologyInvariants2D.h. */
+  itkSetMacro(UseVectorizedClassification, bool);
+  itkGetConstMacro(UseVectorizedClassification, bool);
+  itkBooleanMacro(UseVectorizedClassification);
+
+  /** Record which voxels of the output differ from the input (default: false).
+   * The list is filled while writing the output, in increasing order. */
+  itkSetMacro(ComputeChangedVoxels, bool);
+  itkGetConstMacro(ComputeChangedVoxels, bool);
+  itkBooleanMacro(ComputeChangedVoxels);
+
+  /** Linear offsets of the voxels added or removed relative to the input, empty unless
+   * ComputeChangedVoxels is on. The offsets index the buffer of the output image, i.e.
+   * they are flat indices into the C-ordered NumPy view of the output. */
+  itkGetConstObjectMacro(ChangedVoxels, ChangedVoxelContainerType);
+
 #ifdef ITK_USE_CONCEPT_CHECKING
   /** Begin concept checking */
-  itkConceptMacro(SameDimensionCheck, (Concept::SameDimension<InputImageDimension, 3>));
+  itkConceptMacro(SameDimensionCheck, (Concept::SameDimension<InputImageDimension, OutputImageDimension>));
   itkConceptMacro(SameTypeCheck, (Concept::SameType<InputImagePixelType, OutputImagePixelType>));
   itkConceptMacro(InputAdditiveOperatorsCheck, (Concept::AdditiveOperators<InputImagePixelType>));
   itkConceptMacro(InputConvertibleToIntCheck, (Concept::Convertible<InputImagePixelType, int>));
@@ -113,22 +169,219 @@ protected:
   void
   PrepareData(ProgressAccumulator * progress);
 
-  virtual MaskImageType *
-  CreateDefaultMask(ProgressAccumulator * progress) = 0;
+  /** Build m_SparseState block by block from the input and the mask (or the default mask), and compute
+   * m_SparseDistance for the blocks which can be touched by the carving */
+  void
+  PrepareSparseData();
+
+  /** Write the output from m_SparseState. Voxels outside of the allocated blocks still hold the state of
+   * the input, so only the allocated blocks are read. output_value(state, input_value) returns the output
+   * value of a voxel. */
+  template <typename TOutputValueFunction>
+  void
+  WriteSparseOutput(TOutputValueFunction && output_value);
+
+  /** Binary image of the input mask (kHardForeground) in the sub-region 'region' of the padded region,
+   * the padding layer is background */
+  MaskImageTypePointer
+  ExtractInputMask(const RegionType & region) const;
+
+  /** Signed distance map of the input mask (negative inside) in the sub-region 'region' of the
+   * padded region. Near the border of 'region' the distance can be larger than in the full map. */
+  typename RealImageType::Pointer
+  ComputeDistanceMap(const RegionType & region) const;
+
+  /** Number of block layers (along the last axis) for which the sparse distance map is computed at once */
+  static constexpr IndexValueType SparseDistanceSlabBlocks = 4;
+
+  /** Container to append changed voxels to, or nullptr if ComputeChangedVoxels is off */
+  typename ChangedVoxelContainerType::STLContainerType *
+  GetChangedVoxelsBuffer()
+  {
+    return m_ComputeChangedVoxels ? &m_ChangedVoxels->CastToSTLContainer() : nullptr;
+  }
+
+  /** Maximum number of voxels classified together if UseVectorizedClassification is on */
+  static constexpr size_t ClassifyBatchSize = 256;
+
+  /** Hash of a voxel index, for the lookup of the voxels in a classification batch */
+  struct IndexHash
+  {
+    size_t
+    operator()(const typename RegionType::IndexType & idx) const
+    {
+      size_t h = 0;
+      for (unsigned int d = 0; d < RegionType::ImageDimension; ++d)
+      {
+        h = h * 0x9E3779B97F4A7C15ull + static_cast<size_t>(idx[d]);
+      }
+      return h;
+    }
+  };
+
+  /** Position of each voxel of a classification batch in the batch */
+  using BatchPositionMapType = std::unordered_map<typename RegionType::IndexType, size_t, IndexHash>;
+
+  /** Flag the voxels of a batch in the 3^D neighborhood of idx, whose configurations are outdated once
+   * idx changed earlier in the same batch. Costs one lookup per neighbor, independent of the batch size. */
+  static void
+  FlagOutdatedNeighbors(const typename RegionType::IndexType & idx,
+                        const BatchPositionMapType &           positions,
+                        std::vector<uint8_t> &                 outdated)
+  {
+    for (unsigned int n = 0; n < NeighborhoodSize; ++n)
+    {
+      auto neighbor = idx;
+      for (unsigned int d = 0, k = n; d < RegionType::ImageDimension; ++d, k /= 3)
+      {
+        neighbor[d] += static_cast<IndexValueType>(k % 3) - 1;
+      }
+      const auto it = positions.find(neighbor);
+      if (it != positions.end())
+      {
+        outdated[it->second] = 1;
+      }
+    }
+  }
+
+  /** Dilate (carve outside) or erode (carve inside) the hard foreground of 'image' by Radius.
+   * progress may be nullptr. */
+  virtual MaskImageTypePointer
+  CreateDefaultMask(const MaskImageType * image, ProgressAccumulator * progress) = 0;
 
   virtual void
   ComputeThinImage(ProgressAccumulator * progress) = 0;
 
-  std::vector<typename InputImageType::OffsetType>
+  /** Carve the soft foreground inside region only. Voxels which are not carved are settled (become
+   * hard foreground or background), so regions can be processed one after the other or, if they do
+   * not interact, concurrently. */
+  virtual void
+  CarveRegion(const RegionType & region) = 0;
+
+  /** Mark voxels where mask_image differs from the input mask as kSoftForeground. Voxels which no longer
+   * have the state of the input (changed by an earlier batch mask) are not marked. */
+  void
+  MarkSoftForeground(const MaskImageType * mask_image, const RegionType & region);
+
+  /** Mark and carve all batch masks (see AddMaskImage) */
+  void
+  ProcessMaskImages();
+
+  /** Face neighbors (the first 2 * ImageDimension offsets), followed by the neighbors which share an edge
+   * with the center: 18-connectivity in 3D, 8-connectivity in 2D */
+  static std::vector<typename InputImageType::OffsetType>
   GetNeighborOffsets()
   {
-    // 18-connectivity
     using OffsetType = typename InputImageType::OffsetType;
-    return { OffsetType{ -1, 0, 0 }, OffsetType{ 1, 0, 0 }, OffsetType{ 0, -1, 0 },  OffsetType{ 0, 1, 0 },
-             OffsetType{ 0, 0, -1 }, OffsetType{ 0, 0, 1 }, OffsetType{ -1, -1, 0 }, OffsetType{ 1, -1, 0 },
-             OffsetType{ -1, 1, 0 }, OffsetType{ 1, 1, 0 }, OffsetType{ 0, -1, -1 }, OffsetType{ 0, 1, -1 },
-             OffsetType{ 0, -1, 1 }, OffsetType{ 0, 1, 1 }, OffsetType{ -1, 0, -1 }, OffsetType{ 1, 0, -1 },
-             OffsetType{ -1, 0, 1 }, OffsetType{ 1, 0, 1 } };
+    std::vector<OffsetType> offsets;
+    for (unsigned int d = 0; d < ImageDimension; ++d)
+    {
+      for (OffsetValueType a : { -1, 1 })
+      {
+        OffsetType o{};
+        o[d] = a;
+        offsets.push_back(o);
+      }
+    }
+    // axis pairs (0, 1), (1, 2), (0, 2)
+    for (unsigned int k = 1; k < ImageDimension; ++k)
+    {
+      for (unsigned int d = 0; d + k < ImageDimension; ++d)
+      {
+        for (OffsetValueType b : { -1, 1 })
+        {
+          for (OffsetValueType a : { -1, 1 })
+          {
+            OffsetType o{};
+            o[d] = a;
+            o[d + k] = b;
+            offsets.push_back(o);
+          }
+        }
+      }
+    }
+    return offsets;
+  }
+
+  /** Number of voxels in the 3x3 (2D) or 3x3x3 (3D) neighborhood */
+  static constexpr unsigned int NeighborhoodSize = (ImageDimension == 2) ? 9 : 27;
+
+  /** Gather the 3^D neighborhood of idx in m_PaddedOutput into vals, x running fastest (same order as
+   * itk::Neighborhood and SparseBlockGrid::GetNeighborhood). A voxel is 1 if is_foreground(state) holds,
+   * neighbors outside of the buffer (around the padding layer) are 0. */
+  template <typename TNeighborhood, typename TForegroundFunction>
+  void
+  GetPaddedNeighborhood(const typename RegionType::IndexType & idx,
+                        TNeighborhood &                        vals,
+                        TForegroundFunction &&                 is_foreground) const
+  {
+    const auto & buffer = m_PaddedOutput->GetBufferedRegion();
+    bool         interior = true;
+    for (unsigned int d = 0; d < ImageDimension && interior; ++d)
+    {
+      interior = idx[d] > buffer.GetIndex(d) &&
+                 idx[d] < buffer.GetIndex(d) + static_cast<IndexValueType>(buffer.GetSize(d)) - 1;
+    }
+
+    if (interior)
+    {
+      const auto * center = m_PaddedOutput->GetBufferPointer() + m_PaddedOutput->ComputeOffset(idx);
+      for (unsigned int n = 0; n < NeighborhoodSize; ++n)
+      {
+        vals[n] = is_foreground(center[m_PaddedNeighborOffsets[n]]) ? 1 : 0;
+      }
+    }
+    else
+    {
+      for (unsigned int n = 0; n < NeighborhoodSize; ++n)
+      {
+        auto neighbor = idx;
+        for (unsigned int d = 0, k = n; d < ImageDimension; ++d, k /= 3)
+        {
+          neighbor[d] += static_cast<IndexValueType>(k % 3) - 1;
+        }
+        vals[n] = buffer.IsInside(neighbor) && is_foreground(m_PaddedOutput->GetPixel(neighbor)) ? 1 : 0;
+      }
+    }
+  }
+
+  /** Can the center be removed from the foreground (1) of the binary neighborhood 'vals'? (carve outside) */
+  template <typename TNeighborhood>
+  static bool
+  IsSimpleRemoval(const TNeighborhood & vals)
+  {
+    return IsSimpleRemoval(vals, DimensionTag());
+  }
+
+  /** Can the center be added to the foreground (1) of the binary neighborhood 'vals'? (carve inside) */
+  template <typename TNeighborhood>
+  static bool
+  IsSimpleAddition(const TNeighborhood & vals)
+  {
+    return IsSimpleAddition(vals, DimensionTag());
+  }
+
+  /** Bit packed binary neighborhood for ClassifyRemoval and ClassifyAddition */
+  template <typename TNeighborhood>
+  static uint32_t
+  PackNeighborhood(const TNeighborhood & vals)
+  {
+    return PackNeighborhood(vals, DimensionTag());
+  }
+
+  /** Batched IsSimpleRemoval on packed neighborhoods, using the SIMD kernels of TopologyInvariantsBatch.h in
+   * 3D and the table in 2D */
+  static void
+  ClassifyRemoval(const uint32_t * configs, size_t count, uint8_t * simple)
+  {
+    ClassifyRemoval(configs, count, simple, DimensionTag());
+  }
+
+  /** Batched IsSimpleAddition on packed neighborhoods */
+  static void
+  ClassifyAddition(const uint32_t * configs, size_t count, uint8_t * simple)
+  {
+    ClassifyAddition(configs, count, simple, DimensionTag());
   }
 
   enum ePixelState : OutputImagePixelType
@@ -141,11 +394,95 @@ protected:
 
   MaskImageTypePointer m_PaddedOutput;
 
-  using RealImageType = itk::Image<float, 3>;
-  RealImageType::Pointer m_DistanceMap;
+  /** Linear offsets of the 3^D neighborhood in the buffer of m_PaddedOutput (see GetPaddedNeighborhood) */
+  std::array<OffsetValueType, NeighborhoodSize> m_PaddedNeighborOffsets{};
+
+  typename RealImageType::Pointer m_DistanceMap;
+
+  using SparseStateType = SparseBlockGrid<typename MaskImageType::PixelType, ImageDimension>;
+  using SparseDistanceType = SparseBlockGrid<float, ImageDimension>;
+  SparseStateType    m_SparseState;
+  SparseDistanceType m_SparseDistance;
+
+  typename ChangedVoxelContainerType::Pointer m_ChangedVoxels;
 
   SizeValueType       m_Radius = 1;
   InputImagePixelType m_InsideValue = 1;
+  bool                m_UseSparseState = false;
+  bool                m_ComputeChangedVoxels = false;
+  bool                m_UseVectorizedClassification = false;
+
+private:
+  using DimensionTag = std::integral_constant<unsigned int, ImageDimension>;
+  using Dimension2Tag = std::integral_constant<unsigned int, 2>;
+  using Dimension3Tag = std::integral_constant<unsigned int, 3>;
+
+  template <typename TNeighborhood>
+  static bool
+  IsSimpleRemoval(const TNeighborhood & vals, Dimension2Tag)
+  {
+    return topology::SimplePointTable2D()[topology::PackNeighborhood2D(vals, 1)] & topology::kSimpleRemoval;
+  }
+
+  template <typename TNeighborhood>
+  static bool
+  IsSimpleRemoval(const TNeighborhood & vals, Dimension3Tag)
+  {
+    // deletion does not change connectivity in the 3x3x3 neighborhood
+    return topology::EulerInvariant(vals, 1) && topology::CCInvariant(vals, 1) && topology::CCInvariant(vals, 0);
+  }
+
+  template <typename TNeighborhood>
+  static bool
+  IsSimpleAddition(const TNeighborhood & vals, Dimension2Tag)
+  {
+    return topology::SimplePointTable2D()[topology::PackNeighborhood2D(vals, 1)] & topology::kSimpleAddition;
+  }
+
+  template <typename TNeighborhood>
+  static bool
+  IsSimpleAddition(const TNeighborhood & vals, Dimension3Tag)
+  {
+    return topology::EulerInvariant(vals, 0) && topology::CCInvariant(vals, 0);
+  }
+
+  template <typename TNeighborhood>
+  static uint32_t
+  PackNeighborhood(const TNeighborhood & vals, Dimension2Tag)
+  {
+    return topology::PackNeighborhood2D(vals, 1);
+  }
+
+  template <typename TNeighborhood>
+  static uint32_t
+  PackNeighborhood(const TNeighborhood & vals, Dimension3Tag)
+  {
+    return topology::PackNeighborhood(vals, 1);
+  }
+
+  static void
+  ClassifyRemoval(const uint32_t * configs, size_t count, uint8_t * simple, Dimension2Tag)
+  {
+    topology::ClassifySimplePoints2D(configs, count, simple, topology::kSimpleRemoval);
+  }
+
+  static void
+  ClassifyRemoval(const uint32_t * configs, size_t count, uint8_t * simple, Dimension3Tag)
+  {
+    topology::ClassifyForegroundRemoval(configs, count, simple);
+  }
+
+  static void
+  ClassifyAddition(const uint32_t * configs, size_t count, uint8_t * simple, Dimension2Tag)
+  {
+    topology::ClassifySimplePoints2D(configs, count, simple, topology::kSimpleAddition);
+  }
+
+  static void
+  ClassifyAddition(const uint32_t * configs, size_t count, uint8_t * simple, Dimension3Tag)
+  {
+    topology::ClassifyForegroundAddition(configs, count, simple);
+  }
 }; // end of FixTopologyBase class
 
 } // end namespace itk
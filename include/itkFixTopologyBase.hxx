@@ -22,9 +22,15 @@
 #include "itkFixTopologyBase.h"
 
 #include "itkImageRegionConstIterator.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkImageRegionIterator.h"
+#include "itkImageRegionIteratorWithIndex.h"
 #include "itkImageRegionRange.h"
 #include "itkSignedMaurerDistanceMapImageFilter.h"
 
+#include <algorithm>
+#include <cmath>
+
 namespace itk
 {
 
@@ -32,20 +38,7 @@ template <class TInputImage, class TOutputImage, class TMaskImage>
 FixTopologyBase<TInputImage, TOutputImage, TMaskImage>::FixTopologyBase()
 {
   this->SetNumberOfRequiredOutputs(1);
-}
-
-template <class TInputImage, class TOutputImage, class TMaskImage>
-void
-FixTopologyBase<TInputImage, TOutputImage, TMaskImage>::SetMaskImage(const TMaskImage * mask)
-{
-  this->ProcessObject::SetNthInput(1, const_cast<TMaskImage *>(mask));
-}
-
-template <class TInputImage, class TOutputImage, class TMaskImage>
-const TMaskImage *
-FixTopologyBase<TInputImage, TOutputImage, TMaskImage>::GetMaskImage() const
-{
-  return itkDynamicCastInDebugMode<MaskImageType *>(const_cast<DataObject *>(this->ProcessObject::GetInput(1)));
+  m_ChangedVoxels = ChangedVoxelContainerType::New();
 }
 
 template <class TInputImage, class TOutputImage, class TMaskImage>
@@ -57,6 +50,13 @@ FixTopologyBase<TInputImage, TOutputImage, TMaskImage>::PrepareData(ProgressAccu
   thin_image->SetBufferedRegion(thin_image->GetRequestedRegion());
   thin_image->Allocate();
 
+  // the sparse state is built from the input directly, without the dense state
+  if (m_UseSparseState && this->GetNumberOfMaskImages() == 0)
+  {
+    this->PrepareSparseData();
+    return;
+  }
+
   // pad by 1 layer so we can get 1x1x1 neighborhood without checking if we are at boundary
   auto region = thin_image->GetRequestedRegion();
   auto padded_region = region;
@@ -68,6 +68,16 @@ FixTopologyBase<TInputImage, TOutputImage, TMaskImage>::PrepareData(ProgressAccu
   m_PaddedOutput->Allocate();
   m_PaddedOutput->FillBuffer(ePixelState::kBackground);
 
+  const auto offset_table = m_PaddedOutput->GetOffsetTable();
+  for (unsigned int n = 0; n < NeighborhoodSize; ++n)
+  {
+    m_PaddedNeighborOffsets[n] = 0;
+    for (unsigned int d = 0, k = n; d < ImageDimension; ++d, k /= 3)
+    {
+      m_PaddedNeighborOffsets[n] += (static_cast<OffsetValueType>(k % 3) - 1) * offset_table[d];
+    }
+  }
+
   ImageRegionConstIterator<TInputImage> it(input_image, region);
   ImageRegionIterator<MaskImageType>    ot(m_PaddedOutput, region);
 
@@ -83,6 +93,7 @@ FixTopologyBase<TInputImage, TOutputImage, TMaskImage>::PrepareData(ProgressAccu
   // compute distance map: used for priority queue
   auto distance_filter = SignedMaurerDistanceMapImageFilter<MaskImageType, RealImageType>::New();
   progress->RegisterInternalFilter(distance_filter, 0.1);
+  distance_filter->SetNumberOfWorkUnits(this->GetNumberOfWorkUnits());
   distance_filter->SetInput(m_PaddedOutput);
   distance_filter->SetUseImageSpacing(true);
   distance_filter->SetInsideIsPositive(false);
@@ -91,24 +102,505 @@ FixTopologyBase<TInputImage, TOutputImage, TMaskImage>::PrepareData(ProgressAccu
   distance_filter->Update();
   m_DistanceMap = distance_filter->GetOutput();
 
-  typename MaskImageType::ConstPointer mask_image = GetMaskImage();
+  // batch masks are marked and carved one by one, sharing the state and distance map
+  if (this->GetNumberOfMaskImages() > 0)
+  {
+    return;
+  }
+
+  typename MaskImageType::ConstPointer mask_image = this->GetMaskImage();
+  typename MaskImageType::Pointer      default_mask;
   if (!mask_image)
   {
     // if no mask is provided we dilate the input mask
-    mask_image = this->CreateDefaultMask(progress);
+    default_mask = this->CreateDefaultMask(m_PaddedOutput, progress);
+    mask_image = default_mask.GetPointer();
   }
 
-  // mark dilated as '2', but don't copy padding layer
+  this->MarkSoftForeground(mask_image, region);
+
+  // the default mask is only needed for marking, release it before the carving
+  mask_image = nullptr;
+  if (default_mask)
+  {
+    default_mask->ReleaseData();
+  }
+}
+
+template <class TInputImage, class TOutputImage, class TMaskImage>
+void
+FixTopologyBase<TInputImage, TOutputImage, TMaskImage>::MarkSoftForeground(const MaskImageType * mask_image,
+                                                                           const RegionType &    region)
+{
+  InputImagePointer input_image = dynamic_cast<const TInputImage *>(ProcessObject::GetInput(0));
+
+  // Mark dilated as '2', but don't copy padding layer. Voxels changed by an earlier batch mask are settled
+  // and are not marked again, so a mask does not undo what an overlapping mask added or removed.
+  ImageRegionConstIterator<TInputImage>   it(input_image, region);
   ImageRegionConstIterator<MaskImageType> mt(mask_image, region);
-  for (mt.GoToBegin(), ot.GoToBegin(); !ot.IsAtEnd(); ++mt, ++ot)
+  ImageRegionIterator<MaskImageType>      ot(m_PaddedOutput, region);
+  for (it.GoToBegin(), mt.GoToBegin(), ot.GoToBegin(); !ot.IsAtEnd(); ++it, ++mt, ++ot)
   {
-    if (mt.Get() != ot.Get())
+    const auto input_state = it.Get() == m_InsideValue ? ePixelState::kHardForeground : ePixelState::kBackground;
+    if (ot.Get() == input_state && mt.Get() != input_state)
     {
       ot.Set(ePixelState::kSoftForeground);
     }
   }
 }
 
+template <class TInputImage, class TOutputImage, class TMaskImage>
+void
+FixTopologyBase<TInputImage, TOutputImage, TMaskImage>::ProcessMaskImages()
+{
+  const auto     region = this->GetOutput()->GetRequestedRegion();
+  const unsigned num_masks = this->GetNumberOfMaskImages();
+
+  std::vector<RegionType> mask_regions(num_masks);
+  for (unsigned int i = 0; i < num_masks; ++i)
+  {
+    mask_regions[i] = this->GetMaskImage(i)->GetBufferedRegion();
+    if (!mask_regions[i].Crop(region))
+    {
+      mask_regions[i] = RegionType();
+    }
+  }
+
+  // Carving a region writes inside it and reads up to two voxels around it. Masks which are closer
+  // interact: they are grouped, marked together and carved as one region (the bounding box of the
+  // group), so the result does not depend on the order of the masks. Groups are merged until their
+  // boxes are apart as well, then they do not interact and are carved concurrently.
+  auto interact = [](const RegionType & a, const RegionType & b) {
+    auto padded = a;
+    padded.PadByRadius(2);
+    return padded.Crop(b);
+  };
+
+  std::vector<RegionType>                group_regions;
+  std::vector<std::vector<unsigned int>> group_masks;
+  for (unsigned int i = 0; i < num_masks; ++i)
+  {
+    if (mask_regions[i].GetNumberOfPixels() > 0)
+    {
+      group_regions.push_back(mask_regions[i]);
+      group_masks.push_back({ i });
+    }
+  }
+
+  for (bool merged = true; merged;)
+  {
+    merged = false;
+    for (size_t a = 0; a < group_regions.size(); ++a)
+    {
+      for (size_t b = a + 1; b < group_regions.size();)
+      {
+        if (!interact(group_regions[a], group_regions[b]))
+        {
+          ++b;
+          continue;
+        }
+
+        auto lower = group_regions[a].GetIndex();
+        auto upper = group_regions[a].GetUpperIndex();
+        for (unsigned int d = 0; d < ImageDimension; ++d)
+        {
+          lower[d] = std::min(lower[d], group_regions[b].GetIndex(d));
+          upper[d] = std::max(upper[d], group_regions[b].GetUpperIndex()[d]);
+          group_regions[a].SetSize(d, static_cast<SizeValueType>(upper[d] - lower[d] + 1));
+        }
+        group_regions[a].SetIndex(lower);
+        group_masks[a].insert(group_masks[a].end(), group_masks[b].begin(), group_masks[b].end());
+        group_regions.erase(group_regions.begin() + b);
+        group_masks.erase(group_masks.begin() + b);
+        merged = true;
+      }
+    }
+  }
+
+  auto carve_group = [&](SizeValueType k) {
+    for (const auto i : group_masks[k])
+    {
+      this->MarkSoftForeground(this->GetMaskImage(i), mask_regions[i]);
+    }
+    this->CarveRegion(group_regions[k]);
+  };
+
+  if (this->GetNumberOfWorkUnits() > 1)
+  {
+    this->GetMultiThreader()->SetNumberOfWorkUnits(this->GetNumberOfWorkUnits());
+    this->GetMultiThreader()->ParallelizeArray(0, group_regions.size(), carve_group, this);
+  }
+  else
+  {
+    // e.g. a slice filter already running on a pool thread, don't submit nested work
+    for (SizeValueType k = 0; k < group_regions.size(); ++k)
+    {
+      carve_group(k);
+    }
+  }
+  this->UpdateProgress(1.0f);
+}
+
+template <class TInputImage, class TOutputImage, class TMaskImage>
+void
+FixTopologyBase<TInputImage, TOutputImage, TMaskImage>::PrepareSparseData()
+{
+  using IndexType = typename RegionType::IndexType;
+  using MaskPixelType = typename MaskImageType::PixelType;
+
+  InputImagePointer     input_image = dynamic_cast<const TInputImage *>(ProcessObject::GetInput(0));
+  const MaskImageType * mask_image = this->GetMaskImage();
+  const auto            region = this->GetOutput()->GetRequestedRegion();
+  auto                  padded_region = region;
+  padded_region.PadByRadius(1);
+
+  m_SparseState.Initialize(padded_region, ePixelState::kBackground);
+  m_SparseDistance.Initialize(padded_region, 0.0f);
+  const size_t num_blocks = m_SparseState.GetNumberOfBlocks();
+
+  // Initial state of the voxels of block_region (inside region): the input mask is kHardForeground,
+  // voxels where the mask image differs from the input mask are kSoftForeground
+  const auto for_each_initial_state = [&](const RegionType & block_region, auto && f) {
+    ImageRegionConstIteratorWithIndex<TInputImage> it(input_image, block_region);
+    if (mask_image)
+    {
+      ImageRegionConstIterator<MaskImageType> mt(mask_image, block_region);
+      for (; !it.IsAtEnd(); ++it, ++mt)
+      {
+        const MaskPixelType state = it.Get() == m_InsideValue ? ePixelState::kHardForeground : ePixelState::kBackground;
+        f(it.GetIndex(), mt.Get() != state ? MaskPixelType(ePixelState::kSoftForeground) : state);
+      }
+    }
+    else
+    {
+      for (; !it.IsAtEnd(); ++it)
+      {
+        f(it.GetIndex(), it.Get() == m_InsideValue ? ePixelState::kHardForeground : ePixelState::kBackground);
+      }
+    }
+  };
+
+  // constant blocks stay tiles, the others are allocated
+  for (size_t block = 0; block < num_blocks; ++block)
+  {
+    const auto block_region = m_SparseState.GetBlockRegion(block);
+    auto       inner_region = block_region;
+    if (!inner_region.Crop(region))
+      continue;
+
+    // the padding layer is background
+    bool          has_value = !(inner_region == block_region);
+    MaskPixelType value = ePixelState::kBackground;
+    bool          is_constant = true;
+    for_each_initial_state(inner_region, [&](const IndexType &, MaskPixelType state) {
+      value = has_value ? value : state;
+      has_value = true;
+      is_constant = is_constant && state == value;
+    });
+
+    m_SparseState.SetBlockValue(block, value);
+    if (!is_constant)
+    {
+      for_each_initial_state(inner_region, [this](const IndexType & idx, MaskPixelType state) {
+        m_SparseState.SetPixel(idx, state);
+      });
+    }
+  }
+
+  // Blocks are grouped into slabs of a few block layers along the last axis, the default mask and the
+  // distance map are computed on the bounding box of the blocks of a slab.
+  const auto last_axis = ImageDimension - 1;
+  const auto num_layers = static_cast<IndexValueType>(m_SparseState.GetGridSize()[last_axis]);
+  const auto num_slabs = (num_layers + SparseDistanceSlabBlocks - 1) / SparseDistanceSlabBlocks;
+
+  const auto group_slabs = [&](const std::vector<size_t> & blocks) {
+    std::vector<std::vector<size_t>> slabs(static_cast<size_t>(num_slabs));
+    for (auto block : blocks)
+    {
+      slabs[static_cast<size_t>(m_SparseState.GetBlockIndex(block)[last_axis] / SparseDistanceSlabBlocks)].push_back(
+        block);
+    }
+    return slabs;
+  };
+
+  const auto bounding_box = [this](const std::vector<size_t> & blocks) {
+    auto box = m_SparseState.GetBlockRegion(blocks.front());
+    for (auto block : blocks)
+    {
+      const auto block_region = m_SparseState.GetBlockRegion(block);
+      for (unsigned int d = 0; d < ImageDimension; ++d)
+      {
+        const auto begin = std::min(box.GetIndex(d), block_region.GetIndex(d));
+        const auto end = std::max(box.GetIndex(d) + static_cast<IndexValueType>(box.GetSize(d)),
+                                  block_region.GetIndex(d) + static_cast<IndexValueType>(block_region.GetSize(d)));
+        box.SetIndex(d, begin);
+        box.SetSize(d, static_cast<SizeValueType>(end - begin));
+      }
+    }
+    return box;
+  };
+
+  if (!mask_image)
+  {
+    // The default mask only differs from the input mask within Radius voxels of the contour, i.e. in blocks
+    // within Radius voxels of an allocated block or of a block with a different constant value.
+    const auto     block_radius = static_cast<IndexValueType>((m_Radius + SparseStateType::BlockWidth - 1) >>
+                                                          SparseStateType::BlockBits);
+    std::vector<size_t> candidates;
+    for (size_t block = 0; block < num_blocks; ++block)
+    {
+      const auto value = m_SparseState.GetBlockValue(block);
+      bool       is_candidate = m_SparseState.IsBlockAllocated(block);
+      if (!is_candidate)
+      {
+        m_SparseState.ForEachNeighborBlock(block, block_radius, [&](size_t neighbor) {
+          is_candidate = is_candidate || m_SparseState.IsBlockAllocated(neighbor) ||
+                         m_SparseState.GetBlockValue(neighbor) != value;
+        });
+      }
+      if (is_candidate)
+      {
+        candidates.push_back(block);
+      }
+    }
+
+    // the dilation (erosion) of a voxel only depends on the input within Radius voxels
+    typename RegionType::SizeType margin;
+    margin.Fill(m_Radius);
+    for (const auto & slab : group_slabs(candidates))
+    {
+      if (slab.empty())
+        continue;
+
+      auto box = bounding_box(slab);
+      box.PadByRadius(margin);
+      box.Crop(padded_region);
+      const auto default_mask = this->CreateDefaultMask(this->ExtractInputMask(box), nullptr);
+
+      for (auto block : slab)
+      {
+        auto inner_region = m_SparseState.GetBlockRegion(block);
+        if (!inner_region.Crop(region))
+          continue;
+
+        ImageRegionConstIteratorWithIndex<MaskImageType> mt(default_mask, inner_region);
+        for (; !mt.IsAtEnd(); ++mt)
+        {
+          if (mt.Get() != m_SparseState.GetPixel(mt.GetIndex()))
+          {
+            m_SparseState.SetPixel(mt.GetIndex(), ePixelState::kSoftForeground);
+          }
+        }
+      }
+    }
+  }
+
+  // The carving only writes soft foreground voxels and seeds (foreground voxels next to background),
+  // and only reads within one voxel of those. A constant block whose neighbor blocks have the same
+  // constant value contains neither, so it can stay a tile.
+  std::vector<size_t> needed;
+  for (size_t block = 0; block < num_blocks; ++block)
+  {
+    const auto value = m_SparseState.GetBlockValue(block);
+    bool       is_needed = m_SparseState.IsBlockAllocated(block);
+    if (!is_needed)
+    {
+      m_SparseState.ForEachNeighborBlock(block, [&](size_t neighbor) {
+        is_needed = is_needed || m_SparseState.IsBlockAllocated(neighbor) ||
+                    m_SparseState.GetBlockValue(neighbor) != value;
+      });
+    }
+    if (is_needed)
+    {
+      needed.push_back(block);
+    }
+  }
+
+  for (auto block : needed)
+  {
+    m_SparseState.AllocateBlock(block);
+  }
+
+  // The distance map is computed for a few block layers at a time, on the bounding box of their needed
+  // blocks padded by a margin. The distance of a voxel is exact if it is smaller than the margin: the
+  // closest contour voxel is then inside the box. The carving reads the distance of soft foreground
+  // voxels and of seeds (which lie on the contour). Soft voxels of the default masks are within
+  // Radius + 1 voxels of the contour, for other masks the margin is increased until the check passes.
+  const auto         spacing = this->GetOutput()->GetSpacing();
+  SpacePrecisionType max_spacing = 0.0;
+  for (unsigned int d = 0; d < ImageDimension; ++d)
+  {
+    max_spacing = std::max<SpacePrecisionType>(max_spacing, spacing[d]);
+  }
+
+  for (const auto & slab : group_slabs(needed))
+  {
+    if (slab.empty())
+      continue;
+
+    const auto box = bounding_box(slab);
+    for (SpacePrecisionType band = (m_Radius + 2) * max_spacing;; band *= 2)
+    {
+      auto                          crop = box;
+      SpacePrecisionType            exact_distance = NumericTraits<SpacePrecisionType>::max();
+      typename RegionType::SizeType margin;
+      for (unsigned int d = 0; d < ImageDimension; ++d)
+      {
+        margin[d] = static_cast<SizeValueType>(std::ceil(band / spacing[d])) + 1;
+      }
+      crop.PadByRadius(margin);
+      crop.Crop(padded_region);
+      for (unsigned int d = 0; d < ImageDimension; ++d)
+      {
+        if (crop.GetIndex(d) != padded_region.GetIndex(d) || crop.GetSize(d) != padded_region.GetSize(d))
+        {
+          exact_distance = std::min<SpacePrecisionType>(exact_distance, margin[d] * spacing[d]);
+        }
+      }
+
+      const auto distance_map = this->ComputeDistanceMap(crop);
+
+      bool is_exact = true;
+      for (auto block : slab)
+      {
+        ImageRegionConstIteratorWithIndex<RealImageType> dt(distance_map, m_SparseState.GetBlockRegion(block));
+        for (; !dt.IsAtEnd() && is_exact; ++dt)
+        {
+          is_exact = m_SparseState.GetPixel(dt.GetIndex()) != ePixelState::kSoftForeground ||
+                     std::abs(dt.Get()) < exact_distance;
+        }
+      }
+
+      if (is_exact || crop == padded_region)
+      {
+        for (auto block : slab)
+        {
+          m_SparseDistance.AllocateBlock(block);
+
+          ImageRegionConstIteratorWithIndex<RealImageType> dt(distance_map, m_SparseState.GetBlockRegion(block));
+          for (; !dt.IsAtEnd(); ++dt)
+          {
+            m_SparseDistance.SetPixel(dt.GetIndex(), dt.Get());
+          }
+        }
+        break;
+      }
+    }
+  }
+}
+
+template <class TInputImage, class TOutputImage, class TMaskImage>
+template <typename TOutputValueFunction>
+void
+FixTopologyBase<TInputImage, TOutputImage, TMaskImage>::WriteSparseOutput(TOutputValueFunction && output_value)
+{
+  InputImagePointer  input_image = dynamic_cast<const TInputImage *>(ProcessObject::GetInput(0));
+  OutputImagePointer thin_image = this->GetOutput();
+  const auto         region = thin_image->GetRequestedRegion();
+  auto *             changed = this->GetChangedVoxelsBuffer();
+
+  // all voxels are written with the state of the input first, offsets follow the output buffer order
+  ImageRegionConstIterator<TInputImage> i_it(input_image, region);
+  ImageRegionIterator<TOutputImage>     o_it(thin_image, region);
+  IdentifierType                        offset = 0;
+  for (; !o_it.IsAtEnd(); ++i_it, ++o_it, ++offset)
+  {
+    const auto input_value = i_it.Get();
+    const auto value =
+      output_value(input_value == m_InsideValue ? ePixelState::kHardForeground : ePixelState::kBackground, input_value);
+    o_it.Set(value);
+    if (changed && value != input_value)
+      changed->push_back(offset);
+  }
+
+  // then the voxels of the allocated blocks are updated
+  const size_t num_input_changed = changed ? changed->size() : 0;
+  m_SparseState.ForEachAllocatedBlock([&](size_t block) {
+    auto block_region = m_SparseState.GetBlockRegion(block);
+    if (!block_region.Crop(region))
+      return;
+
+    ImageRegionConstIterator<TInputImage>       it(input_image, block_region);
+    ImageRegionIteratorWithIndex<TOutputImage> ot(thin_image, block_region);
+    for (; !ot.IsAtEnd(); ++it, ++ot)
+    {
+      const auto input_value = it.Get();
+      const auto value = output_value(m_SparseState.GetPixel(ot.GetIndex()), input_value);
+      if (value == ot.Get())
+        continue;
+
+      // offsets whose 'changed' status flips are appended, see below
+      if (changed && (value != input_value) != (ot.Get() != input_value))
+        changed->push_back(static_cast<IdentifierType>(thin_image->ComputeOffset(ot.GetIndex())));
+      ot.Set(value);
+    }
+  });
+
+  if (changed && changed->size() > num_input_changed)
+  {
+    // An offset which was recorded for the input state and appended again did not change after all,
+    // it is dropped. All other offsets occur once.
+    const auto middle = changed->begin() + static_cast<std::ptrdiff_t>(num_input_changed);
+    std::sort(middle, changed->end());
+    std::inplace_merge(changed->begin(), middle, changed->end());
+
+    size_t count = 0;
+    for (size_t i = 0; i < changed->size(); ++i)
+    {
+      if (i + 1 < changed->size() && (*changed)[i] == (*changed)[i + 1])
+      {
+        ++i;
+        continue;
+      }
+      (*changed)[count++] = (*changed)[i];
+    }
+    changed->resize(count);
+  }
+}
+
+template <class TInputImage, class TOutputImage, class TMaskImage>
+auto
+FixTopologyBase<TInputImage, TOutputImage, TMaskImage>::ExtractInputMask(const RegionType & region) const
+  -> MaskImageTypePointer
+{
+  InputImagePointer input_image = dynamic_cast<const TInputImage *>(ProcessObject::GetInput(0));
+
+  // same binary image as the hard foreground of m_PaddedOutput, the padding layer is background
+  auto binary = MaskImageType::New();
+  binary->SetRegions(region);
+  binary->SetSpacing(this->GetOutput()->GetSpacing());
+  binary->Allocate();
+  binary->FillBuffer(0);
+
+  auto input_region = region;
+  if (input_region.Crop(this->GetOutput()->GetRequestedRegion()))
+  {
+    ImageRegionConstIterator<TInputImage> it(input_image, input_region);
+    ImageRegionIterator<MaskImageType>    bt(binary, input_region);
+    for (; !bt.IsAtEnd(); ++it, ++bt)
+    {
+      bt.Set(it.Get() == m_InsideValue ? ePixelState::kHardForeground : ePixelState::kBackground);
+    }
+  }
+  return binary;
+}
+
+template <class TInputImage, class TOutputImage, class TMaskImage>
+auto
+FixTopologyBase<TInputImage, TOutputImage, TMaskImage>::ComputeDistanceMap(const RegionType & region) const
+  -> typename RealImageType::Pointer
+{
+  auto distance_filter = SignedMaurerDistanceMapImageFilter<MaskImageType, RealImageType>::New();
+  distance_filter->SetNumberOfWorkUnits(this->GetNumberOfWorkUnits());
+  distance_filter->SetInput(this->ExtractInputMask(region));
+  distance_filter->SetUseImageSpacing(true);
+  distance_filter->SetInsideIsPositive(false);
+  distance_filter->SetSquaredDistance(false);
+  distance_filter->SetBackgroundValue(0);
+  distance_filter->Update();
+  return distance_filter->GetOutput();
+}
+
 template <class TInputImage, class TOutputImage, class TMaskImage>
 void
 FixTopologyBase<TInputImage, TOutputImage, TMaskImage>::GenerateData()
@@ -116,9 +608,14 @@ FixTopologyBase<TInputImage, TOutputImage, TMaskImage>::GenerateData()
   ProgressAccumulator::Pointer progress = ProgressAccumulator::New();
   progress->SetMiniPipelineFilter(this);
 
+  m_ChangedVoxels->Initialize();
+
   this->PrepareData(progress);
 
   this->ComputeThinImage(progress);
+
+  m_SparseState.Clear();
+  m_SparseDistance.Clear();
 }
 
 template <class TInputImage, class TOutputImage, class TMaskImage>
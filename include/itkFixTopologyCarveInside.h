@@ -40,7 +40,9 @@ namespace itk
  * \author Bryn Lloyd
  * \ingroup TopologyControl
  */
-template <class TInputImage, class TOutputImage, class TMaskImage = itk::Image<unsigned char, 3>>
+template <class TInputImage,
+          class TOutputImage,
+          class TMaskImage = itk::Image<unsigned char, TInputImage::ImageDimension>>
 class ITK_TEMPLATE_EXPORT FixTopologyCarveInside : public FixTopologyBase<TInputImage, TOutputImage, TMaskImage>
 {
 public:
@@ -73,23 +75,43 @@ public:
   /** Type for mask image  */
   using MaskImageType = TMaskImage;
 
+  /** Type for the pixel type of the input image. */
+  using InputImagePixelType = typename Superclass::InputImagePixelType;
+
   /** Pointer Type for input image. */
   using InputImagePointer = typename InputImageType::ConstPointer;
 
   /** Pointer Type for the output image. */
   using OutputImagePointer = typename OutputImageType::Pointer;
 
+  using RegionType = typename Superclass::RegionType;
+
 protected:
   FixTopologyCarveInside() = default;
   ~FixTopologyCarveInside() override = default;
 
-  MaskImageType *
-  CreateDefaultMask(ProgressAccumulator * progress) override;
+  typename Superclass::MaskImageTypePointer
+  CreateDefaultMask(const MaskImageType * image, ProgressAccumulator * progress) override;
 
   void
   ComputeThinImage(ProgressAccumulator * progress) override;
 
+  void
+  CarveRegion(const RegionType & region) override;
+
   using ePixelState = typename Superclass::ePixelState;
+
+private:
+  /** Dilate from the hard foreground in order of increasing distance while topology does not change.
+   * TState is either the dense padded image or the sparse block grid, for_each_voxel(f) calls
+   * f(index, state) for all voxels which can be part of the carving. */
+  template <typename TState, typename TDistance, typename TNeighborhoodFunction, typename TVoxelFunction>
+  void
+  CarveFromForeground(TState &                 state,
+                      const TDistance &        distance,
+                      TNeighborhoodFunction && get_mask,
+                      TVoxelFunction &&        for_each_voxel,
+                      bool                     report_progress);
 }; // end of FixTopologyCarveInside class
 
 } // end namespace itk
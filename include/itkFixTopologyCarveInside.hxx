@@ -20,27 +20,38 @@
 #define itkFixTopologyCarveInside_hxx
 
 #include "itkFixTopologyCarveInside.h"
-#include "TopologyInvariants.h"
 
 #include "itkBinaryErodeImageFilter.h"
 #include "itkFlatStructuringElement.h"
-#include "itkNeighborhoodIterator.h"
+#include "itkImageRegionIndexRange.h"
+#include "itkImageRegionIteratorWithIndex.h"
+
+#include <array>
+#include <memory>
+#include <queue>
 
 namespace itk
 {
 
 template <class TInputImage, class TOutputImage, class TMaskImage>
-TMaskImage *
-FixTopologyCarveInside<TInputImage, TOutputImage, TMaskImage>::CreateDefaultMask(ProgressAccumulator * progress)
+auto
+FixTopologyCarveInside<TInputImage, TOutputImage, TMaskImage>::CreateDefaultMask(const MaskImageType * image,
+                                                                                 ProgressAccumulator * progress)
+  -> typename Superclass::MaskImageTypePointer
 {
   // if no mask is provided we dilate the input mask
-  using kernel_type = itk::FlatStructuringElement<3>;
-  auto radius = this->GetRadius();
-  auto ball = kernel_type::Ball({ radius, radius, radius }, false);
+  using kernel_type = itk::FlatStructuringElement<ImageDimension>;
+  typename kernel_type::RadiusType radius;
+  radius.Fill(this->GetRadius());
+  auto ball = kernel_type::Ball(radius, false);
 
   auto erode = itk::BinaryErodeImageFilter<MaskImageType, MaskImageType, kernel_type>::New();
-  progress->RegisterInternalFilter(erode, 0.1);
-  erode->SetInput(this->m_PaddedOutput);
+  if (progress)
+  {
+    progress->RegisterInternalFilter(erode, 0.1);
+  }
+  erode->SetNumberOfWorkUnits(this->GetNumberOfWorkUnits());
+  erode->SetInput(image);
   erode->SetKernel(ball);
   erode->SetForegroundValue(ePixelState::kHardForeground);
   erode->SetBackgroundValue(0);
@@ -53,21 +64,151 @@ void
 FixTopologyCarveInside<TInputImage, TOutputImage, TMaskImage>::ComputeThinImage(ProgressAccumulator * accumulator)
 {
   using IndexType = typename InputImageType::IndexType;
-  using NeighborhoodIteratorType = NeighborhoodIterator<TMaskImage, ConstantBoundaryCondition<TMaskImage>>;
 
   OutputImagePointer thin_image = this->GetOutput();
+  auto               region = thin_image->GetRequestedRegion();
+
+  if (this->m_UseSparseState && this->GetNumberOfMaskImages() == 0)
+  {
+    auto & state = this->m_SparseState;
+
+    // voxels in constant blocks are never carved, nor are they next to a carved voxel
+    const auto for_each_voxel = [&state, &region](auto && f) {
+      state.ForEachAllocatedBlock([&](size_t block) {
+        auto block_region = state.GetBlockRegion(block);
+        if (!block_region.Crop(region))
+          return;
+
+        for (const IndexType & idx : ImageRegionIndexRange<ImageDimension>(block_region))
+        {
+          f(idx, state.GetPixel(idx));
+        }
+      });
+    };
+
+    std::array<typename MaskImageType::PixelType, Superclass::NeighborhoodSize> vals;
+    const auto get_mask = [&state, &vals](const IndexType & idx) -> const decltype(vals) & {
+      state.GetNeighborhood(idx, vals);
+      for (auto & v : vals)
+        v = (v == ePixelState::kHardForeground) ? 1 : 0;
+      return vals;
+    };
+
+    CarveFromForeground(state, this->m_SparseDistance, get_mask, for_each_voxel, true);
+
+    // copy to output
+    this->WriteSparseOutput([this](typename MaskImageType::PixelType state, InputImagePixelType) {
+      return state == ePixelState::kHardForeground ? this->m_InsideValue : InputImagePixelType{ 0 };
+    });
+    return;
+  }
 
   // note: all processing is done on padded_output to avoid
   // checking if index is in region
   auto padded_output = this->m_PaddedOutput;
-  auto region = thin_image->GetRequestedRegion();
+
+  if (this->GetNumberOfMaskImages() > 0)
+  {
+    this->ProcessMaskImages();
+  }
+  else
+  {
+    const auto for_each_voxel = [&padded_output, &region](auto && f) {
+      itk::ImageRegionConstIterator<MaskImageType> it(padded_output, region);
+      for (it.GoToBegin(); !it.IsAtEnd(); ++it)
+      {
+        f(it.GetIndex(), it.Get());
+      }
+    };
+
+    std::array<typename MaskImageType::PixelType, Superclass::NeighborhoodSize> vals;
+    const auto get_mask = [this, &vals](const IndexType & idx) -> const decltype(vals) & {
+      this->GetPaddedNeighborhood(
+        idx, vals, [](typename MaskImageType::PixelType v) { return v == ePixelState::kHardForeground; });
+      return vals;
+    };
+
+    CarveFromForeground(*padded_output, *this->m_DistanceMap, get_mask, for_each_voxel, true);
+  }
+
+  // copy to output
+  InputImagePointer input_image = dynamic_cast<const TInputImage *>(ProcessObject::GetInput(0));
+  itk::ImageRegionConstIterator<TInputImage> i_it(input_image, region);
+  itk::ImageRegionConstIterator<TMaskImage>  s_it(padded_output, region);
+  itk::ImageRegionIterator<TOutputImage>     o_it(thin_image, region);
+  auto *                                     changed = this->GetChangedVoxelsBuffer();
+
+  // changed voxels are recorded in the same pass, offsets follow the output buffer order
+  IdentifierType offset = 0;
+  for (i_it.GoToBegin(), s_it.GoToBegin(), o_it.GoToBegin(); !s_it.IsAtEnd(); ++i_it, ++s_it, ++o_it, ++offset)
+  {
+    const auto value = s_it.Get() == ePixelState::kHardForeground ? this->m_InsideValue : 0;
+    o_it.Set(value);
+    if (changed && value != i_it.Get())
+      changed->push_back(offset);
+  }
+}
+
+template <class TInputImage, class TOutputImage, class TMaskImage>
+void
+FixTopologyCarveInside<TInputImage, TOutputImage, TMaskImage>::CarveRegion(const RegionType & region)
+{
+  using IndexType = typename InputImageType::IndexType;
+
+  auto padded_output = this->m_PaddedOutput;
+
+  // the hard foreground next to the soft voxels can be one voxel outside of region
+  auto seed_region = region;
+  seed_region.PadByRadius(1);
+  seed_region.Crop(this->GetOutput()->GetRequestedRegion());
+
+  const auto for_each_voxel = [&padded_output, &seed_region](auto && f) {
+    itk::ImageRegionConstIterator<MaskImageType> it(padded_output, seed_region);
+    for (it.GoToBegin(); !it.IsAtEnd(); ++it)
+    {
+      f(it.GetIndex(), it.Get());
+    }
+  };
+
+  std::array<typename MaskImageType::PixelType, Superclass::NeighborhoodSize> vals;
+  const auto get_mask = [this, &vals](const IndexType & idx) -> const decltype(vals) & {
+    this->GetPaddedNeighborhood(
+      idx, vals, [](typename MaskImageType::PixelType v) { return v == ePixelState::kHardForeground; });
+    return vals;
+  };
+
+  CarveFromForeground(*padded_output, *this->m_DistanceMap, get_mask, for_each_voxel, false);
+
+  // what could not be added stays background
+  for (auto && pixel : ImageRegionRange<MaskImageType>(*padded_output, region))
+  {
+    if (pixel != ePixelState::kHardForeground)
+    {
+      pixel = ePixelState::kBackground;
+    }
+  }
+}
+
+template <class TInputImage, class TOutputImage, class TMaskImage>
+template <typename TState, typename TDistance, typename TNeighborhoodFunction, typename TVoxelFunction>
+void
+FixTopologyCarveInside<TInputImage, TOutputImage, TMaskImage>::CarveFromForeground(TState &                 state,
+                                                                                   const TDistance &        distance,
+                                                                                   TNeighborhoodFunction && get_mask,
+                                                                                   TVoxelFunction && for_each_voxel,
+                                                                                   bool report_progress)
+{
+  using IndexType = typename InputImageType::IndexType;
 
   // for progress reporting
-  size_t                                     mask_size = 0;
-  itk::ImageRegionRange<const MaskImageType> image_range(*padded_output, region);
-  for (auto && pixel : image_range)
+  std::unique_ptr<ProgressReporter> progress;
+  if (report_progress)
   {
-    mask_size += (pixel == ePixelState::kSoftForeground) ? 1 : 0;
+    size_t mask_size = 0;
+    for_each_voxel([&](const IndexType &, typename MaskImageType::PixelType value) {
+      mask_size += (value == ePixelState::kSoftForeground) ? 1 : 0;
+    });
+    progress.reset(new ProgressReporter(this, 0, mask_size, 100));
   }
 
   // process pixels further away from input background first
@@ -84,61 +225,101 @@ FixTopologyCarveInside<TInputImage, TOutputImage, TMaskImage>::ComputeThinImage(
     for (size_t k = 0; k < num_neighbors; ++k)
     {
       const IndexType n_id = idx + neighbors[k];
-      const float     n_dist = this->m_DistanceMap->GetPixel(n_id);
 
-      if (padded_output->GetPixel(n_id) == ePixelState::kSoftForeground)
+      if (state.GetPixel(n_id) == ePixelState::kSoftForeground)
       {
         // mark as visited
-        padded_output->SetPixel(n_id, ePixelState::kQueued);
+        state.SetPixel(n_id, ePixelState::kQueued);
 
         // add to queue
-        queue.push(std::make_pair(n_dist, n_id));
+        queue.push(std::make_pair(distance.GetPixel(n_id), n_id));
       }
     }
   };
 
   // initial seeds
-  itk::ImageRegionConstIterator<MaskImageType> it(padded_output, region);
-  for (it.GoToBegin(); !it.IsAtEnd(); ++it)
-  {
-    if (it.Get() == ePixelState::kHardForeground)
+  for_each_voxel([&](const IndexType & idx, typename MaskImageType::PixelType value) {
+    if (value == ePixelState::kHardForeground)
     {
-      add_neighbors(it.GetIndex());
+      add_neighbors(idx);
     }
-  }
-
-  NeighborhoodIteratorType n_it({ 1, 1, 1 }, padded_output, region);
+  });
 
-  const auto get_mask = [&n_it](const IndexType & idx) {
-    n_it.SetLocation(idx);
-    auto n = n_it.GetNeighborhood();
-    for (auto & v : n.GetBufferReference())
-      v = (v == ePixelState::kHardForeground) ? 1 : 0;
-    return n;
+  auto add = [&](const IndexType & idx) {
+    state.SetPixel(idx, ePixelState::kHardForeground);
+    if (progress)
+      progress->CompletedPixel();
   };
 
+  std::vector<IndexType>                    batch;
+  std::vector<uint32_t>                     configs;
+  std::vector<uint8_t>                      simple;
+  std::vector<uint8_t>                      outdated;
+  typename Superclass::BatchPositionMapType positions;
+
   // dilate while topology does not change
-  ProgressReporter progress(this, 0, mask_size, 100);
   while (true)
   {
     int num_changed = 0;
 
     while (!queue.empty())
     {
+      if (this->m_UseVectorizedClassification)
+      {
+        // classify all queued voxels with the same distance together
+        const float key = queue.top().first;
+        batch.clear();
+        configs.clear();
+        outdated.clear();
+        positions.clear();
+        while (!queue.empty() && queue.top().first == key && batch.size() < Superclass::ClassifyBatchSize)
+        {
+          auto idx = queue.top().second;
+          queue.pop();
+          if (state.GetPixel(idx) == ePixelState::kQueued)
+          {
+            // a voxel queued twice is classified again when its second copy is processed
+            outdated.push_back(positions.emplace(idx, batch.size()).second ? 0 : 1);
+            batch.push_back(idx);
+            configs.push_back(Superclass::PackNeighborhood(get_mask(idx)));
+          }
+        }
+        simple.resize(batch.size());
+        Superclass::ClassifyAddition(configs.data(), configs.size(), simple.data());
+
+        for (size_t i = 0; i < batch.size(); ++i)
+        {
+          const IndexType & idx = batch[i];
+          if (state.GetPixel(idx) != ePixelState::kQueued)
+            continue;
+
+          // the configuration is outdated if a neighbor was added earlier in this batch
+          const bool is_simple = outdated[i] ? Superclass::IsSimpleAddition(get_mask(idx)) : simple[i] != 0;
+          if (is_simple)
+          {
+            add(idx);
+            Superclass::FlagOutdatedNeighbors(idx, positions, outdated);
+            num_changed++;
+          }
+
+          add_neighbors(idx);
+        }
+        continue;
+      }
+
       auto idx = queue.top().second; // node
       queue.pop();
 
       // skip if already processed
-      if (padded_output->GetPixel(idx) != ePixelState::kQueued)
+      if (state.GetPixel(idx) != ePixelState::kQueued)
         continue;
 
-      auto vals = get_mask(idx);
+      const auto & vals = get_mask(idx);
 
-      // check if point is simple (deletion does not change connectivity in the 3x3x3 neighborhood)
-      if (topology::EulerInvariant(vals, 0) && topology::CCInvariant(vals, 0))
+      // check if point is simple (deletion does not change connectivity in the 3^D neighborhood)
+      if (Superclass::IsSimpleAddition(vals))
       {
-        padded_output->SetPixel(idx, ePixelState::kHardForeground);
-        progress.CompletedPixel();
+        add(idx);
         num_changed++;
       }
 
@@ -149,24 +330,12 @@ FixTopologyCarveInside<TInputImage, TOutputImage, TMaskImage>::ComputeThinImage(
     if (num_changed == 0)
       break;
 
-    for (it.GoToBegin(); !it.IsAtEnd(); ++it)
-    {
-      if (it.Get() == ePixelState::kQueued)
+    for_each_voxel([&](const IndexType & idx, typename MaskImageType::PixelType value) {
+      if (value == ePixelState::kQueued)
       {
-        queue.push(std::make_pair(this->m_DistanceMap->GetPixel(it.GetIndex()), it.GetIndex()));
+        queue.push(std::make_pair(distance.GetPixel(idx), idx));
       }
-    }
-  }
-
-  // copy to output
-  InputImagePointer input_image = dynamic_cast<const TInputImage *>(ProcessObject::GetInput(0));
-  itk::ImageRegionConstIterator<TInputImage> i_it(input_image, region);
-  itk::ImageRegionConstIterator<TMaskImage>  s_it(padded_output, region);
-  itk::ImageRegionIterator<TOutputImage>     o_it(thin_image, region);
-
-  for (i_it.GoToBegin(), s_it.GoToBegin(), o_it.GoToBegin(); !s_it.IsAtEnd(); ++i_it, ++s_it, ++o_it)
-  {
-    o_it.Set(s_it.Get() == ePixelState::kHardForeground ? this->m_InsideValue : 0);
+    });
   }
 }
 
@@ -40,7 +40,9 @@ namespace itk
  * \author Bryn Lloyd
  * \ingroup TopologyControl
  */
-template <class TInputImage, class TOutputImage, class TMaskImage = itk::Image<unsigned char, 3>>
+template <class TInputImage,
+          class TOutputImage,
+          class TMaskImage = itk::Image<unsigned char, TInputImage::ImageDimension>>
 class ITK_TEMPLATE_EXPORT FixTopologyCarveOutside : public FixTopologyBase<TInputImage, TOutputImage, TMaskImage>
 {
 public:
@@ -73,23 +75,42 @@ public:
   /** Type for mask image  */
   using MaskImageType = TMaskImage;
 
+  /** Type for the pixel type of the input image. */
+  using InputImagePixelType = typename Superclass::InputImagePixelType;
+
   /** Pointer Type for input image. */
   using InputImagePointer = typename InputImageType::ConstPointer;
 
   /** Pointer Type for the output image. */
   using OutputImagePointer = typename OutputImageType::Pointer;
 
+  using RegionType = typename Superclass::RegionType;
+
 protected:
   FixTopologyCarveOutside() = default;
   ~FixTopologyCarveOutside() override = default;
 
-  MaskImageType *
-  CreateDefaultMask(ProgressAccumulator * progress) override;
+  typename Superclass::MaskImageTypePointer
+  CreateDefaultMask(const MaskImageType * image, ProgressAccumulator * progress) override;
 
   void
   ComputeThinImage(ProgressAccumulator * progress) override;
 
+  void
+  CarveRegion(const RegionType & region) override;
+
   using ePixelState = typename Superclass::ePixelState;
+
+private:
+  /** Erode from seeds in order of decreasing distance while topology does not change.
+   * TState is either the dense padded image or the sparse block grid. */
+  template <typename TState, typename TDistance, typename TNeighborhoodFunction>
+  void
+  CarveFromSeeds(TState &                                                state,
+                 const TDistance &                                       distance,
+                 TNeighborhoodFunction &&                                get_mask,
+                 const std::vector<typename InputImageType::IndexType> & seeds,
+                 ProgressReporter *                                      progress);
 }; // end of FixTopologyCarveOutside class
 
 } // end namespace itk
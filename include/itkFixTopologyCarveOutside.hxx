@@ -20,28 +20,38 @@
 #define itkFixTopologyCarveOutside_hxx
 
 #include "itkFixTopologyCarveOutside.h"
-#include "TopologyInvariants.h"
 
 #include "itkBinaryDilateImageFilter.h"
 #include "itkFlatStructuringElement.h"
 #include "itkImageLinearConstIteratorWithIndex.h"
-#include "itkNeighborhoodIterator.h"
+#include "itkImageRegionIndexRange.h"
+#include "itkImageRegionIteratorWithIndex.h"
+
+#include <array>
+#include <queue>
 
 namespace itk
 {
 
 template <class TInputImage, class TOutputImage, class TMaskImage>
-TMaskImage *
-FixTopologyCarveOutside<TInputImage, TOutputImage, TMaskImage>::CreateDefaultMask(ProgressAccumulator * progress)
+auto
+FixTopologyCarveOutside<TInputImage, TOutputImage, TMaskImage>::CreateDefaultMask(const MaskImageType * image,
+                                                                                  ProgressAccumulator * progress)
+  -> typename Superclass::MaskImageTypePointer
 {
   // if no mask is provided we dilate the input mask
-  using kernel_type = itk::FlatStructuringElement<3>;
-  auto radius = this->GetRadius();
-  auto ball = kernel_type::Ball({ radius, radius, radius }, false);
+  using kernel_type = itk::FlatStructuringElement<ImageDimension>;
+  typename kernel_type::RadiusType radius;
+  radius.Fill(this->GetRadius());
+  auto ball = kernel_type::Ball(radius, false);
 
   auto dilate = itk::BinaryDilateImageFilter<MaskImageType, MaskImageType, kernel_type>::New();
-  progress->RegisterInternalFilter(dilate, 0.1);
-  dilate->SetInput(this->m_PaddedOutput);
+  if (progress)
+  {
+    progress->RegisterInternalFilter(dilate, 0.1);
+  }
+  dilate->SetNumberOfWorkUnits(this->GetNumberOfWorkUnits());
+  dilate->SetInput(image);
   dilate->SetKernel(ball);
   dilate->SetForegroundValue(ePixelState::kHardForeground);
   dilate->Update();
@@ -53,62 +63,201 @@ void
 FixTopologyCarveOutside<TInputImage, TOutputImage, TMaskImage>::ComputeThinImage(ProgressAccumulator * accumulator)
 {
   using IndexType = typename InputImageType::IndexType;
-  using NeighborhoodIteratorType = NeighborhoodIterator<TMaskImage, ConstantBoundaryCondition<TMaskImage>>;
 
   OutputImagePointer thin_image = this->GetOutput();
+  InputImagePointer  input_image = dynamic_cast<const TInputImage *>(ProcessObject::GetInput(0));
+  auto               region = thin_image->GetRequestedRegion();
+
+  if (this->m_UseSparseState && this->GetNumberOfMaskImages() == 0)
+  {
+    auto & state = this->m_SparseState;
+
+    // seeds are foreground voxels with a background face neighbor, only allocated blocks can contain them
+    auto                   neighbors = this->GetNeighborOffsets();
+    std::vector<IndexType> seeds;
+    size_t                 mask_size = 0;
+    state.ForEachAllocatedBlock([&](size_t block) {
+      auto block_region = state.GetBlockRegion(block);
+      if (!block_region.Crop(region))
+        return;
+
+      for (const IndexType & idx : ImageRegionIndexRange<ImageDimension>(block_region))
+      {
+        const auto value = state.GetPixel(idx);
+        mask_size += (value == ePixelState::kSoftForeground) ? 1 : 0;
+        if (value == ePixelState::kBackground)
+          continue;
+
+        for (unsigned int k = 0; k < 2 * ImageDimension; ++k)
+        {
+          if (state.GetPixel(idx + neighbors[k]) == ePixelState::kBackground)
+          {
+            seeds.push_back(idx);
+            break;
+          }
+        }
+      }
+    });
+
+    std::array<typename MaskImageType::PixelType, Superclass::NeighborhoodSize> vals;
+    const auto get_mask = [&state, &vals](const IndexType & idx) -> const decltype(vals) & {
+      state.GetNeighborhood(idx, vals);
+      for (auto & v : vals)
+        v = (v != 0) ? 1 : 0;
+      return vals;
+    };
+
+    ProgressReporter progress(this, 0, mask_size, 100);
+    CarveFromSeeds(state, this->m_SparseDistance, get_mask, seeds, &progress);
+
+    // copy to output
+    this->WriteSparseOutput([this](typename MaskImageType::PixelType state, InputImagePixelType input_value) {
+      return state != ePixelState::kBackground ? this->m_InsideValue : input_value;
+    });
+    return;
+  }
 
   // note: all processing is done on padded_output to avoid
   // checking if index is in region
   auto padded_output = this->m_PaddedOutput;
-  auto region = thin_image->GetRequestedRegion();
 
-  std::vector<IndexType> seeds;
-  for (int direction = 0; direction < ImageDimension; ++direction)
+  if (this->GetNumberOfMaskImages() > 0)
   {
-    ImageLinearConstIteratorWithIndex<MaskImageType> it(padded_output, region);
-    it.SetDirection(direction);
-    it.GoToBegin();
-    for (; !it.IsAtEnd(); it.NextLine())
+    this->ProcessMaskImages();
+  }
+  else
+  {
+    std::vector<IndexType> seeds;
+    for (int direction = 0; direction < ImageDimension; ++direction)
     {
-      auto last_value = it.Get();
-      auto last_idx = it.GetIndex();
-
-      if (last_value) // mask at boundary
+      ImageLinearConstIteratorWithIndex<MaskImageType> it(padded_output, region);
+      it.SetDirection(direction);
+      it.GoToBegin();
+      for (; !it.IsAtEnd(); it.NextLine())
       {
-        seeds.push_back({ last_idx });
-      }
+        auto last_value = it.Get();
+        auto last_idx = it.GetIndex();
 
-      for (; !it.IsAtEndOfLine(); ++it)
-      {
-        if (it.Get() != last_value)
+        if (last_value) // mask at boundary
         {
-          if (last_value) // leaving mask
-          {
-            seeds.push_back({ last_idx });
-          }
-          else // entering mask
+          seeds.push_back({ last_idx });
+        }
+
+        for (; !it.IsAtEndOfLine(); ++it)
+        {
+          if (it.Get() != last_value)
           {
-            seeds.push_back({ it.GetIndex() });
+            if (last_value) // leaving mask
+            {
+              seeds.push_back({ last_idx });
+            }
+            else // entering mask
+            {
+              seeds.push_back({ it.GetIndex() });
+            }
+            last_value = it.Get();
           }
-          last_value = it.Get();
+          last_idx = it.GetIndex();
+        }
+
+        if (last_value && last_idx != it.GetIndex()) // mask at boundary
+        {
+          seeds.push_back({ it.GetIndex() });
         }
-        last_idx = it.GetIndex();
       }
+    }
+
+    // for progress reporting
+    size_t                                     mask_size = 0;
+    itk::ImageRegionRange<const MaskImageType> image_range(*padded_output, region);
+    for (auto && pixel : image_range)
+    {
+      mask_size += (pixel == ePixelState::kSoftForeground) ? 1 : 0;
+    }
+
+    std::array<typename MaskImageType::PixelType, Superclass::NeighborhoodSize> vals;
+    const auto get_mask = [this, &vals](const IndexType & idx) -> const decltype(vals) & {
+      this->GetPaddedNeighborhood(idx, vals, [](typename MaskImageType::PixelType v) { return v != 0; });
+      return vals;
+    };
+
+    ProgressReporter progress(this, 0, mask_size, 100);
+    CarveFromSeeds(*padded_output, *this->m_DistanceMap, get_mask, seeds, &progress);
+  }
+
+  // copy to output
+  itk::ImageRegionConstIterator<TInputImage> i_it(input_image, region);
+  itk::ImageRegionConstIterator<TMaskImage>  s_it(padded_output, region);
+  itk::ImageRegionIterator<TOutputImage>     o_it(thin_image, region);
+  auto *                                     changed = this->GetChangedVoxelsBuffer();
+
+  // changed voxels are recorded in the same pass, offsets follow the output buffer order
+  IdentifierType offset = 0;
+  for (i_it.GoToBegin(), s_it.GoToBegin(), o_it.GoToBegin(); !s_it.IsAtEnd(); ++i_it, ++s_it, ++o_it, ++offset)
+  {
+    const auto value = s_it.Get() != ePixelState::kBackground ? this->m_InsideValue : i_it.Get();
+    o_it.Set(value);
+    if (changed && value != i_it.Get())
+      changed->push_back(offset);
+  }
+}
+
+template <class TInputImage, class TOutputImage, class TMaskImage>
+void
+FixTopologyCarveOutside<TInputImage, TOutputImage, TMaskImage>::CarveRegion(const RegionType & region)
+{
+  using IndexType = typename InputImageType::IndexType;
+
+  auto padded_output = this->m_PaddedOutput;
+  auto neighbors = this->GetNeighborOffsets();
+
+  // Seeds are the soft voxels with a background face neighbor. The hard foreground is never queued,
+  // so the input and voxels settled by a neighboring region are not removed.
+  std::vector<IndexType> seeds;
+  for (const IndexType & idx : ImageRegionIndexRange<ImageDimension>(region))
+  {
+    if (padded_output->GetPixel(idx) != ePixelState::kSoftForeground)
+      continue;
 
-      if (last_value && last_idx != it.GetIndex()) // mask at boundary
+    for (unsigned int k = 0; k < 2 * ImageDimension; ++k)
+    {
+      if (padded_output->GetPixel(idx + neighbors[k]) == ePixelState::kBackground)
       {
-        seeds.push_back({ it.GetIndex() });
+        seeds.push_back(idx);
+        break;
       }
     }
   }
 
-  // for progress reporting
-  size_t                                     mask_size = 0;
-  itk::ImageRegionRange<const MaskImageType> image_range(*padded_output, region);
-  for (auto && pixel : image_range)
+  std::array<typename MaskImageType::PixelType, Superclass::NeighborhoodSize> vals;
+  const auto get_mask = [this, &vals](const IndexType & idx) -> const decltype(vals) & {
+    this->GetPaddedNeighborhood(idx, vals, [](typename MaskImageType::PixelType v) { return v != 0; });
+    return vals;
+  };
+
+  CarveFromSeeds(*padded_output, *this->m_DistanceMap, get_mask, seeds, nullptr);
+
+  // what could not be carved is kept
+  for (auto && pixel : ImageRegionRange<MaskImageType>(*padded_output, region))
   {
-    mask_size += (pixel == ePixelState::kSoftForeground) ? 1 : 0;
+    if (pixel != ePixelState::kBackground)
+    {
+      pixel = ePixelState::kHardForeground;
+    }
   }
+}
+
+template <class TInputImage, class TOutputImage, class TMaskImage>
+template <typename TState, typename TDistance, typename TNeighborhoodFunction>
+void
+FixTopologyCarveOutside<TInputImage, TOutputImage, TMaskImage>::CarveFromSeeds(
+  TState &                                                state,
+  const TDistance &                                       distance,
+  TNeighborhoodFunction &&                                get_mask,
+  const std::vector<typename InputImageType::IndexType> & seeds,
+  ProgressReporter *                                      progress)
+{
+  using IndexType = typename InputImageType::IndexType;
 
   // process pixels further away from input foreground first
   // - distance is positive outside
@@ -118,68 +267,102 @@ FixTopologyCarveOutside<TInputImage, TOutputImage, TMaskImage>::ComputeThinImage
   std::priority_queue<node, std::vector<node>, decltype(cmp)> queue(cmp);
   for (const auto & idx : seeds)
   {
-    padded_output->SetPixel(idx, ePixelState::kQueued);
-    queue.push(std::make_pair(this->m_DistanceMap->GetPixel(idx), idx));
+    state.SetPixel(idx, ePixelState::kQueued);
+    queue.push(std::make_pair(distance.GetPixel(idx), idx));
   }
 
   auto         neighbors = this->GetNeighborOffsets();
   const size_t num_neighbors = neighbors.size();
 
-  NeighborhoodIteratorType n_it({ 1, 1, 1 }, padded_output, region);
+  auto add_neighbors = [&](const IndexType & idx) {
+    for (size_t k = 0; k < num_neighbors; ++k)
+    {
+      const IndexType n_id = idx + neighbors[k];
+
+      if (state.GetPixel(n_id) == ePixelState::kSoftForeground)
+      {
+        // mark as visited
+        state.SetPixel(n_id, ePixelState::kQueued);
+
+        // add to queue
+        queue.push(std::make_pair(distance.GetPixel(n_id), n_id));
+      }
+    }
+  };
 
-  const auto get_mask = [&n_it](const IndexType & idx) {
-    n_it.SetLocation(idx);
-    auto n = n_it.GetNeighborhood();
-    for (auto & v : n.GetBufferReference())
-      v = (v != 0) ? 1 : 0;
-    return n;
+  auto remove = [&](const IndexType & idx) {
+    state.SetPixel(idx, ePixelState::kBackground);
+    if (progress)
+      progress->CompletedPixel();
   };
 
+  std::vector<IndexType>                    batch;
+  std::vector<uint32_t>                     configs;
+  std::vector<uint8_t>                      simple;
+  std::vector<uint8_t>                      outdated;
+  typename Superclass::BatchPositionMapType positions;
+
   // erode while topology does not change
-  ProgressReporter progress(this, 0, mask_size, 100);
   while (!queue.empty())
   {
+    if (this->m_UseVectorizedClassification)
+    {
+      // classify all queued voxels with the same distance together
+      const float key = queue.top().first;
+      batch.clear();
+      configs.clear();
+      outdated.clear();
+      positions.clear();
+      while (!queue.empty() && queue.top().first == key && batch.size() < Superclass::ClassifyBatchSize)
+      {
+        auto idx = queue.top().second;
+        queue.pop();
+        if (state.GetPixel(idx) == ePixelState::kQueued)
+        {
+          // a voxel queued twice is classified again when its second copy is processed
+          outdated.push_back(positions.emplace(idx, batch.size()).second ? 0 : 1);
+          batch.push_back(idx);
+          configs.push_back(Superclass::PackNeighborhood(get_mask(idx)));
+        }
+      }
+      simple.resize(batch.size());
+      Superclass::ClassifyRemoval(configs.data(), configs.size(), simple.data());
+
+      for (size_t i = 0; i < batch.size(); ++i)
+      {
+        const IndexType & idx = batch[i];
+        if (state.GetPixel(idx) != ePixelState::kQueued)
+          continue;
+
+        // the configuration is outdated if a neighbor was removed earlier in this batch
+        const bool is_simple = outdated[i] ? Superclass::IsSimpleRemoval(get_mask(idx)) : simple[i] != 0;
+        if (is_simple)
+        {
+          remove(idx);
+          Superclass::FlagOutdatedNeighbors(idx, positions, outdated);
+        }
+
+        add_neighbors(idx);
+      }
+      continue;
+    }
+
     auto idx = queue.top().second; // node
     queue.pop();
 
-    if (padded_output->GetPixel(idx) != ePixelState::kQueued)
+    if (state.GetPixel(idx) != ePixelState::kQueued)
       continue;
 
-    auto vals = get_mask(idx);
+    const auto & vals = get_mask(idx);
 
-    // check if point is simple (deletion does not change connectivity in the 3x3x3 neighborhood)
-    if (topology::EulerInvariant(vals, 1) && topology::CCInvariant(vals, 1) && topology::CCInvariant(vals, 0))
+    // check if point is simple (deletion does not change connectivity in the 3^D neighborhood)
+    if (Superclass::IsSimpleRemoval(vals))
     {
-      padded_output->SetPixel(idx, ePixelState::kBackground);
-      progress.CompletedPixel();
+      remove(idx);
     }
 
     // add unvisited neighbors to queue
-    for (size_t k = 0; k < num_neighbors; ++k)
-    {
-      const IndexType n_id = idx + neighbors[k];
-      const float     n_dist = this->m_DistanceMap->GetPixel(n_id);
-
-      if (padded_output->GetPixel(n_id) == ePixelState::kSoftForeground)
-      {
-        // mark as visited
-        padded_output->SetPixel(n_id, ePixelState::kQueued);
-
-        // add to queue
-        queue.push(std::make_pair(n_dist, n_id));
-      }
-    }
-  }
-
-  // copy to output
-  InputImagePointer input_image = dynamic_cast<const TInputImage *>(ProcessObject::GetInput(0));
-  itk::ImageRegionConstIterator<TInputImage> i_it(input_image, region);
-  itk::ImageRegionConstIterator<TMaskImage>  s_it(padded_output, region);
-  itk::ImageRegionIterator<TOutputImage>     o_it(thin_image, region);
-
-  for (i_it.GoToBegin(), s_it.GoToBegin(), o_it.GoToBegin(); !s_it.IsAtEnd(); ++i_it, ++s_it, ++o_it)
-  {
-    o_it.Set(s_it.Get() != ePixelState::kBackground ? this->m_InsideValue : i_it.Get());
+    add_neighbors(idx);
   }
 }
 
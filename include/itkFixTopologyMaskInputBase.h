@@ -0,0 +1,85 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef itkFixTopologyMaskInputBase_h
+#define itkFixTopologyMaskInputBase_h
+
+#include "itkImageToImageFilter.h"
+
+namespace itk
+{
+/** \class FixTopologyMaskInputBase
+ *
+ * \brief Mask inputs shared by the topology control filters
+ *
+ * Input 0 is the image, input 1 the optional mask (SetMaskImage), and the batch masks (AddMaskImage)
+ * follow at index 2, 3, ... The optional mask must cover the requested region of the output. The batch
+ * masks only need to cover a sub-region of the input, in the same index space (e.g. cropped with
+ * ExtractImageFilter); their whole buffer is requested.
+ *
+ * \ingroup TopologyControl
+ */
+template <class TInputImage, class TOutputImage, class TMaskImage>
+class ITK_TEMPLATE_EXPORT FixTopologyMaskInputBase : public ImageToImageFilter<TInputImage, TOutputImage>
+{
+public:
+  ITK_DISALLOW_COPY_AND_MOVE(FixTopologyMaskInputBase);
+
+  /** Standard class typedefs. */
+  using Self = FixTopologyMaskInputBase;
+  using Superclass = ImageToImageFilter<TInputImage, TOutputImage>;
+  using Pointer = SmartPointer<Self>;
+  using ConstPointer = SmartPointer<const Self>;
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(FixTopologyMaskInputBase, ImageToImageFilter);
+
+  /** Type for mask image  */
+  using MaskImageType = TMaskImage;
+
+  /** Optional mask, which replaces the default mask computed from the input */
+  void
+  SetMaskImage(const MaskImageType * mask);
+  const MaskImageType *
+  GetMaskImage() const;
+
+  /** Batch processing: add a mask which is carved into the shared result */
+  void
+  AddMaskImage(const MaskImageType * mask);
+  void
+  ClearMaskImages();
+  unsigned int
+  GetNumberOfMaskImages() const;
+  const MaskImageType *
+  GetMaskImage(unsigned int i) const;
+
+protected:
+  FixTopologyMaskInputBase() = default;
+  ~FixTopologyMaskInputBase() override = default;
+
+  void
+  GenerateInputRequestedRegion() override;
+}; // end of FixTopologyMaskInputBase class
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#  include "itkFixTopologyMaskInputBase.hxx"
+#endif
+
+#endif // itkFixTopologyMaskInputBase_h
@@ -0,0 +1,96 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef itkFixTopologyMaskInputBase_hxx
+#define itkFixTopologyMaskInputBase_hxx
+
+#include "itkFixTopologyMaskInputBase.h"
+
+#include <algorithm>
+
+namespace itk
+{
+
+template <class TInputImage, class TOutputImage, class TMaskImage>
+void
+FixTopologyMaskInputBase<TInputImage, TOutputImage, TMaskImage>::SetMaskImage(const TMaskImage * mask)
+{
+  this->ProcessObject::SetNthInput(1, const_cast<TMaskImage *>(mask));
+}
+
+template <class TInputImage, class TOutputImage, class TMaskImage>
+const TMaskImage *
+FixTopologyMaskInputBase<TInputImage, TOutputImage, TMaskImage>::GetMaskImage() const
+{
+  return itkDynamicCastInDebugMode<MaskImageType *>(const_cast<DataObject *>(this->ProcessObject::GetInput(1)));
+}
+
+template <class TInputImage, class TOutputImage, class TMaskImage>
+void
+FixTopologyMaskInputBase<TInputImage, TOutputImage, TMaskImage>::AddMaskImage(const TMaskImage * mask)
+{
+  // batch masks follow the optional mask at index 1
+  const auto idx = std::max<ProcessObject::DataObjectPointerArraySizeType>(2, this->GetNumberOfIndexedInputs());
+  this->ProcessObject::SetNthInput(idx, const_cast<TMaskImage *>(mask));
+}
+
+template <class TInputImage, class TOutputImage, class TMaskImage>
+void
+FixTopologyMaskInputBase<TInputImage, TOutputImage, TMaskImage>::ClearMaskImages()
+{
+  if (this->GetNumberOfIndexedInputs() > 2)
+  {
+    this->SetNumberOfIndexedInputs(2);
+    this->Modified();
+  }
+}
+
+template <class TInputImage, class TOutputImage, class TMaskImage>
+unsigned int
+FixTopologyMaskInputBase<TInputImage, TOutputImage, TMaskImage>::GetNumberOfMaskImages() const
+{
+  const auto num_inputs = this->GetNumberOfIndexedInputs();
+  return num_inputs > 2 ? static_cast<unsigned int>(num_inputs - 2) : 0;
+}
+
+template <class TInputImage, class TOutputImage, class TMaskImage>
+const TMaskImage *
+FixTopologyMaskInputBase<TInputImage, TOutputImage, TMaskImage>::GetMaskImage(unsigned int i) const
+{
+  return itkDynamicCastInDebugMode<MaskImageType *>(const_cast<DataObject *>(this->ProcessObject::GetInput(2 + i)));
+}
+
+template <class TInputImage, class TOutputImage, class TMaskImage>
+void
+FixTopologyMaskInputBase<TInputImage, TOutputImage, TMaskImage>::GenerateInputRequestedRegion()
+{
+  Superclass::GenerateInputRequestedRegion();
+
+  // batch masks may cover only part of the input
+  for (unsigned int i = 0; i < GetNumberOfMaskImages(); ++i)
+  {
+    if (auto mask = const_cast<MaskImageType *>(GetMaskImage(i)))
+    {
+      mask->SetRequestedRegionToLargestPossibleRegion();
+    }
+  }
+}
+
+} // end namespace itk
+
+#endif // itkFixTopologyMaskInputBase_hxx
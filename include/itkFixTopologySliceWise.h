@@ -0,0 +1,196 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef itkFixTopologySliceWise_h
+#define itkFixTopologySliceWise_h
+
+#include "itkFixTopologyBase.h"
+
+#include <array>
+
+namespace itk
+{
+/** \class FixTopologySliceWise
+ *
+ * \brief Morphological closing/opening with topology constraints inside each 2D slice
+ *
+ * Carves like FixTopologyCarveOutside (default) or FixTopologyCarveInside (CarveInside on), but the
+ * topology is only preserved within 2D slices. Each slice is carved by the 2D instance of these filters,
+ * so the same options (masks, batch masks, sparse state, vectorized classification and changed voxels)
+ * are available.
+ *
+ * A 2D input is processed as a single slice. A 3D input is treated as a stack of slices orthogonal to
+ * SliceDirection, e.g. for thick-slice CT where holes should be closed in each slice but not across
+ * slices. The slices are independent and are carved concurrently by the multi-threader, each one by a
+ * single work unit, so the slice filters do not submit work to the pool themselves.
+ *
+ * If no mask is set (SetMaskImage), each slice of the input mask is dilated (or eroded) by 'Radius'. A mask
+ * must cover the requested region of the output, otherwise an exception is thrown. The part of each batch
+ * mask (AddMaskImage) in a slice is passed to the filter of the slice, slices a batch mask does not
+ * intersect are skipped.
+ *
+ * \ingroup TopologyControl
+ */
+template <class TInputImage,
+          class TOutputImage,
+          class TMaskImage = itk::Image<unsigned char, TInputImage::ImageDimension>>
+class ITK_TEMPLATE_EXPORT FixTopologySliceWise
+  : public FixTopologyMaskInputBase<TInputImage, TOutputImage, TMaskImage>
+{
+public:
+  ITK_DISALLOW_COPY_AND_MOVE(FixTopologySliceWise);
+
+  /** Extract dimension from input and output image. */
+  itkStaticConstMacro(InputImageDimension, unsigned int, TInputImage::ImageDimension);
+  itkStaticConstMacro(OutputImageDimension, unsigned int, TOutputImage::ImageDimension);
+
+  static const unsigned int ImageDimension = InputImageDimension;
+
+  static_assert(ImageDimension == 2 || ImageDimension == 3, "FixTopologySliceWise supports 2D and 3D images.");
+
+  /** Standard class typedefs. */
+  using Self = FixTopologySliceWise;
+  using Superclass = FixTopologyMaskInputBase<TInputImage, TOutputImage, TMaskImage>;
+  using Pointer = SmartPointer<Self>;
+  using ConstPointer = SmartPointer<const Self>;
+
+  /** Method for creation through the object factory */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(FixTopologySliceWise, FixTopologyMaskInputBase);
+
+  /** Type for input image. */
+  using InputImageType = TInputImage;
+
+  /** Type for output image. */
+  using OutputImageType = TOutputImage;
+
+  /** Type for mask image  */
+  using MaskImageType = TMaskImage;
+
+  /** Type for the pixel type of the input image. */
+  using InputImagePixelType = typename InputImageType::PixelType;
+
+  /** Type for the pixel type of the input image. */
+  using OutputImagePixelType = typename OutputImageType::PixelType;
+
+  /** Pointer Type for input image. */
+  using InputImagePointer = typename InputImageType::ConstPointer;
+
+  /** Pointer Type for the output image. */
+  using OutputImagePointer = typename OutputImageType::Pointer;
+
+  /** Region type of the output image. */
+  using RegionType = typename OutputImageType::RegionType;
+
+  /** Filter which carves a single slice */
+  using SliceFilterType = FixTopologyBase<Image<InputImagePixelType, 2>,
+                                          Image<OutputImagePixelType, 2>,
+                                          Image<typename MaskImageType::PixelType, 2>>;
+
+  /** Container for the linear offsets (into the output buffer) of changed voxels. */
+  using ChangedVoxelContainerType = typename SliceFilterType::ChangedVoxelContainerType;
+
+  itkSetMacro(Radius, SizeValueType);
+  itkGetConstMacro(Radius, SizeValueType);
+
+  itkSetMacro(InsideValue, InputImagePixelType);
+  itkGetConstMacro(InsideValue, InputImagePixelType);
+
+  /** Carve from the inside (opening, as FixTopologyCarveInside) instead of the outside (closing, default) */
+  itkSetMacro(CarveInside, bool);
+  itkGetConstMacro(CarveInside, bool);
+  itkBooleanMacro(CarveInside);
+
+  /** Axis orthogonal to the slices of a 3D image (default: 2, i.e. axial slices). Ignored for 2D images. */
+  itkSetMacro(SliceDirection, unsigned int);
+  itkGetConstMacro(SliceDirection, unsigned int);
+
+  /** See FixTopologyBase::SetUseSparseState */
+  itkSetMacro(UseSparseState, bool);
+  itkGetConstMacro(UseSparseState, bool);
+  itkBooleanMacro(UseSparseState);
+
+  /** See FixTopologyBase::SetUseVectorizedClassification */
+  itkSetMacro(UseVectorizedClassification, bool);
+  itkGetConstMacro(UseVectorizedClassification, bool);
+  itkBooleanMacro(UseVectorizedClassification);
+
+  /** Record which voxels of the output differ from the input (default: false) */
+  itkSetMacro(ComputeChangedVoxels, bool);
+  itkGetConstMacro(ComputeChangedVoxels, bool);
+  itkBooleanMacro(ComputeChangedVoxels);
+
+  /** Linear offsets (into the output buffer) of the voxels added or removed relative to the input, in
+   * increasing order. Empty unless ComputeChangedVoxels is on. */
+  itkGetConstObjectMacro(ChangedVoxels, ChangedVoxelContainerType);
+
+#ifdef ITK_USE_CONCEPT_CHECKING
+  /** Begin concept checking */
+  itkConceptMacro(SameDimensionCheck, (Concept::SameDimension<InputImageDimension, OutputImageDimension>));
+  itkConceptMacro(SameTypeCheck, (Concept::SameType<InputImagePixelType, OutputImagePixelType>));
+  itkConceptMacro(InputConvertibleToIntCheck, (Concept::Convertible<InputImagePixelType, int>));
+  itkConceptMacro(IntConvertibleToInputCheck, (Concept::Convertible<int, InputImagePixelType>));
+  itkConceptMacro(InputIntComparableCheck, (Concept::Comparable<InputImagePixelType, int>));
+  /** End concept checking */
+#endif
+
+protected:
+  FixTopologySliceWise();
+  ~FixTopologySliceWise() override = default;
+  void
+  PrintSelf(std::ostream & os, Indent indent) const override;
+
+  void
+  GenerateData() override;
+
+  /** Carve the slice at position 'slice' along SliceDirection (ignored for 2D images). The changed voxels
+   * of the slice are appended to 'changed'. */
+  void
+  ProcessSlice(IndexValueType slice, std::vector<IdentifierType> & changed);
+
+private:
+  /** Axes spanning the slices */
+  std::array<unsigned int, 2>
+  GetSliceAxes() const;
+
+  /** Copy the part of 'image' inside 'region' and the slice at position 'slice' into a 2D image with index
+   * (idx[axes[0]], idx[axes[1]]). Returns nullptr if they do not intersect. */
+  template <typename TImage>
+  typename Image<typename TImage::PixelType, 2>::Pointer
+  ExtractSlice(const TImage * image, RegionType region, IndexValueType slice) const;
+
+  typename ChangedVoxelContainerType::Pointer m_ChangedVoxels;
+
+  SizeValueType       m_Radius = 1;
+  InputImagePixelType m_InsideValue = 1;
+  bool                m_CarveInside = false;
+  unsigned int        m_SliceDirection = ImageDimension - 1;
+  bool                m_UseSparseState = false;
+  bool                m_UseVectorizedClassification = false;
+  bool                m_ComputeChangedVoxels = false;
+}; // end of FixTopologySliceWise class
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#  include "itkFixTopologySliceWise.hxx"
+#endif
+
+#endif // itkFixTopologySliceWise_h
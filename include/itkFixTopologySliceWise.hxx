@@ -0,0 +1,249 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef itkFixTopologySliceWise_hxx
+#define itkFixTopologySliceWise_hxx
+
+#include "itkFixTopologySliceWise.h"
+
+#include "itkFixTopologyCarveInside.h"
+#include "itkFixTopologyCarveOutside.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionIterator.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace itk
+{
+
+template <class TInputImage, class TOutputImage, class TMaskImage>
+FixTopologySliceWise<TInputImage, TOutputImage, TMaskImage>::FixTopologySliceWise()
+{
+  this->SetNumberOfRequiredOutputs(1);
+  m_ChangedVoxels = ChangedVoxelContainerType::New();
+}
+
+template <class TInputImage, class TOutputImage, class TMaskImage>
+void
+FixTopologySliceWise<TInputImage, TOutputImage, TMaskImage>::GenerateData()
+{
+  if (ImageDimension == 3 && m_SliceDirection >= ImageDimension)
+  {
+    itkExceptionMacro("SliceDirection " << m_SliceDirection << " must be smaller than " << ImageDimension);
+  }
+
+  OutputImagePointer output = this->GetOutput();
+  output->SetBufferedRegion(output->GetRequestedRegion());
+  output->Allocate();
+
+  const auto region = output->GetRequestedRegion();
+  const auto mask = this->GetMaskImage();
+  if (mask && !mask->GetBufferedRegion().IsInside(region))
+  {
+    itkExceptionMacro("MaskImage with buffered region " << mask->GetBufferedRegion()
+                                                        << " does not cover the output region " << region);
+  }
+
+  IndexValueType first_slice = 0;
+  SizeValueType  num_slices = 1;
+  if (ImageDimension == 3)
+  {
+    first_slice = region.GetIndex(m_SliceDirection);
+    num_slices = region.GetSize(m_SliceDirection);
+  }
+
+  // The slices do not interact, each one is carved by a single work unit of the pool. A 2D image is a
+  // single slice, which is carved on this thread by a filter with all work units.
+  std::vector<std::vector<IdentifierType>> changed(num_slices);
+  if (ImageDimension == 3)
+  {
+    this->GetMultiThreader()->SetNumberOfWorkUnits(this->GetNumberOfWorkUnits());
+    this->GetMultiThreader()->ParallelizeArray(
+      0,
+      num_slices,
+      [this, first_slice, &changed](SizeValueType k) {
+        this->ProcessSlice(first_slice + static_cast<IndexValueType>(k), changed[k]);
+      },
+      this);
+  }
+  else
+  {
+    this->ProcessSlice(first_slice, changed[0]);
+  }
+
+  m_ChangedVoxels->Initialize();
+  if (m_ComputeChangedVoxels)
+  {
+    auto & offsets = m_ChangedVoxels->CastToSTLContainer();
+    for (const auto & slice_offsets : changed)
+    {
+      offsets.insert(offsets.end(), slice_offsets.begin(), slice_offsets.end());
+    }
+    std::sort(offsets.begin(), offsets.end());
+  }
+}
+
+template <class TInputImage, class TOutputImage, class TMaskImage>
+void
+FixTopologySliceWise<TInputImage, TOutputImage, TMaskImage>::ProcessSlice(IndexValueType                slice,
+                                                                           std::vector<IdentifierType> & changed)
+{
+  using SliceInputImageType = typename SliceFilterType::InputImageType;
+  using SliceOutputImageType = typename SliceFilterType::OutputImageType;
+
+  OutputImagePointer output = this->GetOutput();
+  const auto         region = output->GetRequestedRegion();
+  const auto         axes = GetSliceAxes();
+
+  typename SliceFilterType::Pointer filter;
+  if (m_CarveInside)
+  {
+    filter = FixTopologyCarveInside<SliceInputImageType, SliceOutputImageType>::New().GetPointer();
+  }
+  else
+  {
+    filter = FixTopologyCarveOutside<SliceInputImageType, SliceOutputImageType>::New().GetPointer();
+  }
+
+  // the slices of a 3D image are processed concurrently, each one by a single work unit (see GenerateData)
+  filter->SetNumberOfWorkUnits(ImageDimension == 3 ? 1 : this->GetNumberOfWorkUnits());
+  filter->SetInput(ExtractSlice(this->GetInput(), region, slice));
+  filter->SetRadius(m_Radius);
+  filter->SetInsideValue(m_InsideValue);
+  filter->SetUseSparseState(m_UseSparseState);
+  filter->SetUseVectorizedClassification(m_UseVectorizedClassification);
+  filter->SetComputeChangedVoxels(m_ComputeChangedVoxels);
+  if (const MaskImageType * mask = this->GetMaskImage())
+  {
+    filter->SetMaskImage(ExtractSlice(mask, region, slice));
+  }
+  for (unsigned int i = 0; i < this->GetNumberOfMaskImages(); ++i)
+  {
+    // batch masks which do not intersect the slice are skipped
+    if (auto mask = ExtractSlice(this->GetMaskImage(i), region, slice))
+    {
+      filter->AddMaskImage(mask);
+    }
+  }
+  filter->Update();
+
+  // copy to output
+  auto slice_region = region;
+  if (ImageDimension == 3)
+  {
+    slice_region.SetIndex(m_SliceDirection, slice);
+    slice_region.SetSize(m_SliceDirection, 1);
+  }
+
+  const SliceOutputImageType *                     slice_output = filter->GetOutput();
+  ImageRegionConstIterator<SliceOutputImageType> it(slice_output, slice_output->GetBufferedRegion());
+  ImageRegionIterator<TOutputImage>              ot(output, slice_region);
+  for (; !ot.IsAtEnd(); ++it, ++ot)
+  {
+    ot.Set(it.Get());
+  }
+
+  // the offsets of the slice filter index the slice buffer
+  for (const auto offset : filter->GetChangedVoxels()->CastToSTLConstContainer())
+  {
+    const auto p = slice_output->ComputeIndex(static_cast<OffsetValueType>(offset));
+    auto       idx = slice_region.GetIndex();
+    idx[axes[0]] = p[0];
+    idx[axes[1]] = p[1];
+    changed.push_back(static_cast<IdentifierType>(output->ComputeOffset(idx)));
+  }
+}
+
+template <class TInputImage, class TOutputImage, class TMaskImage>
+std::array<unsigned int, 2>
+FixTopologySliceWise<TInputImage, TOutputImage, TMaskImage>::GetSliceAxes() const
+{
+  std::array<unsigned int, 2> axes = { { 0, 1 } };
+  if (ImageDimension == 3)
+  {
+    for (unsigned int d = 0, k = 0; d < ImageDimension; ++d)
+    {
+      if (d != m_SliceDirection)
+        axes[k++] = d;
+    }
+  }
+  return axes;
+}
+
+template <class TInputImage, class TOutputImage, class TMaskImage>
+template <typename TImage>
+auto
+FixTopologySliceWise<TInputImage, TOutputImage, TMaskImage>::ExtractSlice(const TImage * image,
+                                                                           RegionType     region,
+                                                                           IndexValueType slice) const
+  -> typename Image<typename TImage::PixelType, 2>::Pointer
+{
+  using SliceImageType = Image<typename TImage::PixelType, 2>;
+
+  if (ImageDimension == 3)
+  {
+    region.SetIndex(m_SliceDirection, slice);
+    region.SetSize(m_SliceDirection, 1);
+  }
+  if (!region.Crop(image->GetBufferedRegion()))
+  {
+    return nullptr;
+  }
+
+  const auto                          axes = GetSliceAxes();
+  typename SliceImageType::RegionType slice_region;
+  typename SliceImageType::SpacingType spacing;
+  for (unsigned int k = 0; k < 2; ++k)
+  {
+    slice_region.SetIndex(k, region.GetIndex(axes[k]));
+    slice_region.SetSize(k, region.GetSize(axes[k]));
+    spacing[k] = image->GetSpacing()[axes[k]];
+  }
+
+  auto slice_image = SliceImageType::New();
+  slice_image->SetRegions(slice_region);
+  slice_image->SetSpacing(spacing);
+  slice_image->Allocate();
+
+  // the region has size 1 along the slice direction, so both iterators visit the pixels in the same order
+  ImageRegionConstIterator<TImage>      it(image, region);
+  ImageRegionIterator<SliceImageType> st(slice_image, slice_region);
+  for (; !st.IsAtEnd(); ++it, ++st)
+  {
+    st.Set(it.Get());
+  }
+  return slice_image;
+}
+
+template <class TInputImage, class TOutputImage, class TMaskImage>
+void
+FixTopologySliceWise<TInputImage, TOutputImage, TMaskImage>::PrintSelf(std::ostream & os, Indent indent) const
+{
+  Superclass::PrintSelf(os, indent);
+  os << indent << "Radius: " << m_Radius << std::endl;
+  os << indent << "CarveInside: " << m_CarveInside << std::endl;
+  os << indent << "SliceDirection: " << m_SliceDirection << std::endl;
+  os << indent << "UseSparseState: " << m_UseSparseState << std::endl;
+  os << indent << "UseVectorizedClassification: " << m_UseVectorizedClassification << std::endl;
+  os << indent << "ComputeChangedVoxels: " << m_ComputeChangedVoxels << std::endl;
+}
+
+} // end namespace itk
+
+#endif // itkFixTopologySliceWise_hxx
@@ -0,0 +1,378 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef itkSparseBlockGrid_h
+#define itkSparseBlockGrid_h
+
+#include "itkImageRegion.h"
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace itk
+{
+/** \class SparseBlockGrid
+ *
+ * \brief Block-sparse voxel container for thin working sets
+ *
+ * The region is tiled into blocks of 8^D voxels. A block either holds a single
+ * constant value (a "tile" in VDB terms) or owns a dense buffer. Memory and
+ * the cost of visiting all allocated voxels are proportional to the number of
+ * allocated blocks, not to the size of the region.
+ *
+ * Indices passed to GetPixel/SetPixel must lie inside the region.
+ *
+ * \ingroup TopologyControl
+ */
+template <typename TValue, unsigned int VDimension = 3>
+class SparseBlockGrid
+{
+public:
+  static constexpr unsigned int   Dimension = VDimension;
+  static constexpr unsigned int   BlockBits = 3;
+  static constexpr IndexValueType BlockWidth = IndexValueType{ 1 } << BlockBits;
+  static constexpr size_t         BlockVoxels = size_t{ 1 } << (BlockBits * VDimension);
+
+  using ValueType = TValue;
+  using IndexType = Index<VDimension>;
+  using OffsetType = Offset<VDimension>;
+  using SizeType = Size<VDimension>;
+  using RegionType = ImageRegion<VDimension>;
+  using BlockIdType = size_t;
+
+  /** Tile 'region' into blocks which all hold the constant 'value' */
+  void
+  Initialize(const RegionType & region, ValueType value)
+  {
+    m_Region = region;
+    size_t num_blocks = 1;
+    for (unsigned int d = 0; d < VDimension; ++d)
+    {
+      m_GridSize[d] = (region.GetSize(d) + BlockWidth - 1) >> BlockBits;
+      m_GridStride[d] = num_blocks;
+      num_blocks *= m_GridSize[d];
+    }
+    m_Blocks.clear();
+    m_Blocks.resize(num_blocks);
+    for (auto & block : m_Blocks)
+    {
+      block.m_Value = value;
+    }
+  }
+
+  /** Release all blocks */
+  void
+  Clear()
+  {
+    m_Blocks.clear();
+    m_Region = RegionType();
+    m_GridSize.Fill(0);
+  }
+
+  const RegionType &
+  GetRegion() const
+  {
+    return m_Region;
+  }
+
+  const SizeType &
+  GetGridSize() const
+  {
+    return m_GridSize;
+  }
+
+  size_t
+  GetNumberOfBlocks() const
+  {
+    return m_Blocks.size();
+  }
+
+  size_t
+  GetNumberOfAllocatedBlocks() const
+  {
+    size_t count = 0;
+    for (const auto & block : m_Blocks)
+    {
+      count += block.m_Data ? 1 : 0;
+    }
+    return count;
+  }
+
+  /** Approximate memory footprint in bytes */
+  size_t
+  GetMemorySize() const
+  {
+    return m_Blocks.size() * sizeof(Block) + GetNumberOfAllocatedBlocks() * BlockVoxels * sizeof(ValueType);
+  }
+
+  ValueType
+  GetPixel(const IndexType & idx) const
+  {
+    BlockIdType block;
+    size_t      offset;
+    ComputeBlockAndOffset(idx, block, offset);
+    const Block & b = m_Blocks[block];
+    return b.m_Data ? b.m_Data[offset] : b.m_Value;
+  }
+
+  /** Set a voxel, allocating its block if the value differs from the block constant */
+  void
+  SetPixel(const IndexType & idx, ValueType value)
+  {
+    BlockIdType block;
+    size_t      offset;
+    ComputeBlockAndOffset(idx, block, offset);
+    Block & b = m_Blocks[block];
+    if (!b.m_Data)
+    {
+      if (b.m_Value == value)
+      {
+        return;
+      }
+      AllocateBlock(block);
+    }
+    b.m_Data[offset] = value;
+  }
+
+  /** Gather the 3^D neighborhood around idx, x running fastest (same order as itk::Neighborhood).
+   * The neighborhood must lie inside the region. */
+  template <typename TContainer>
+  void
+  GetNeighborhood(const IndexType & idx, TContainer & values) const
+  {
+    BlockIdType block;
+    size_t      offset;
+    ComputeBlockAndOffset(idx, block, offset);
+
+    const Block & b = m_Blocks[block];
+    bool          interior = (b.m_Data != nullptr);
+    for (unsigned int d = 0; d < VDimension && interior; ++d)
+    {
+      const IndexValueType local = (idx[d] - m_Region.GetIndex(d)) & (BlockWidth - 1);
+      interior = (local > 0 && local < BlockWidth - 1);
+    }
+
+    if (interior)
+    {
+      // fast path: all neighbors are in the same allocated block
+      const ValueType * center = b.m_Data.get() + offset;
+      for (unsigned int n = 0, count = NeighborhoodSize(); n < count; ++n)
+      {
+        values[n] = center[NeighborBlockOffset(n)];
+      }
+    }
+    else
+    {
+      for (unsigned int n = 0, count = NeighborhoodSize(); n < count; ++n)
+      {
+        values[n] = GetPixel(idx + NeighborOffset(n));
+      }
+    }
+  }
+
+  bool
+  IsBlockAllocated(BlockIdType block) const
+  {
+    return m_Blocks[block].m_Data != nullptr;
+  }
+
+  ValueType
+  GetBlockValue(BlockIdType block) const
+  {
+    return m_Blocks[block].m_Value;
+  }
+
+  /** Turn block into a constant tile, releasing its buffer */
+  void
+  SetBlockValue(BlockIdType block, ValueType value)
+  {
+    m_Blocks[block].m_Data.reset();
+    m_Blocks[block].m_Value = value;
+  }
+
+  /** Allocate a dense buffer for block, initialized with the block constant */
+  void
+  AllocateBlock(BlockIdType block)
+  {
+    Block & b = m_Blocks[block];
+    if (!b.m_Data)
+    {
+      b.m_Data.reset(new ValueType[BlockVoxels]);
+      std::fill_n(b.m_Data.get(), BlockVoxels, b.m_Value);
+    }
+  }
+
+  /** Position of block in the block grid */
+  IndexType
+  GetBlockIndex(BlockIdType block) const
+  {
+    IndexType grid_idx;
+    for (unsigned int d = VDimension; d-- > 0;)
+    {
+      grid_idx[d] = static_cast<IndexValueType>(block / m_GridStride[d]);
+      block %= m_GridStride[d];
+    }
+    return grid_idx;
+  }
+
+  /** Voxel region covered by block, clipped to the grid region */
+  RegionType
+  GetBlockRegion(BlockIdType block) const
+  {
+    const IndexType grid_idx = GetBlockIndex(block);
+    IndexType       start;
+    SizeType        size;
+    for (unsigned int d = 0; d < VDimension; ++d)
+    {
+      const IndexValueType begin = grid_idx[d] << BlockBits;
+      const IndexValueType end =
+        std::min<IndexValueType>(begin + BlockWidth, static_cast<IndexValueType>(m_Region.GetSize(d)));
+      start[d] = m_Region.GetIndex(d) + begin;
+      size[d] = static_cast<SizeValueType>(end - begin);
+    }
+    return RegionType(start, size);
+  }
+
+  /** Call f(block) for each block in the 3^D block neighborhood of block (excluding block itself) */
+  template <typename TFunction>
+  void
+  ForEachNeighborBlock(BlockIdType block, TFunction && f) const
+  {
+    ForEachNeighborBlock(block, 1, std::forward<TFunction>(f));
+  }
+
+  /** Call f(block) for each block whose grid position differs from the one of block by at most radius along
+   * each axis (excluding block itself) */
+  template <typename TFunction>
+  void
+  ForEachNeighborBlock(BlockIdType block, IndexValueType radius, TFunction && f) const
+  {
+    const IndexType grid_idx = GetBlockIndex(block);
+    IndexType       begin;
+    IndexType       end;
+    for (unsigned int d = 0; d < VDimension; ++d)
+    {
+      begin[d] = std::max<IndexValueType>(grid_idx[d] - radius, 0);
+      end[d] = std::min<IndexValueType>(grid_idx[d] + radius, static_cast<IndexValueType>(m_GridSize[d]) - 1);
+    }
+
+    // x running fastest
+    IndexType n = begin;
+    for (unsigned int d = 0; d < VDimension;)
+    {
+      BlockIdType neighbor = 0;
+      for (unsigned int k = 0; k < VDimension; ++k)
+      {
+        neighbor += static_cast<BlockIdType>(n[k]) * m_GridStride[k];
+      }
+      if (neighbor != block)
+      {
+        f(neighbor);
+      }
+
+      for (d = 0; d < VDimension && n[d] == end[d]; ++d)
+      {
+        n[d] = begin[d];
+      }
+      if (d < VDimension)
+      {
+        ++n[d];
+      }
+    }
+  }
+
+  /** Call f(block) for each allocated block, in storage order */
+  template <typename TFunction>
+  void
+  ForEachAllocatedBlock(TFunction && f) const
+  {
+    for (BlockIdType block = 0; block < m_Blocks.size(); ++block)
+    {
+      if (m_Blocks[block].m_Data)
+      {
+        f(block);
+      }
+    }
+  }
+
+private:
+  struct Block
+  {
+    ValueType                    m_Value{};
+    std::unique_ptr<ValueType[]> m_Data;
+  };
+
+  static constexpr unsigned int
+  NeighborhoodSize()
+  {
+    unsigned int count = 1;
+    for (unsigned int d = 0; d < VDimension; ++d)
+    {
+      count *= 3;
+    }
+    return count;
+  }
+
+  /** Offset of n-th voxel in 3^D neighborhood relative to its center */
+  static OffsetType
+  NeighborOffset(unsigned int n)
+  {
+    OffsetType o;
+    for (unsigned int d = 0; d < VDimension; ++d, n /= 3)
+    {
+      o[d] = static_cast<OffsetValueType>(n % 3) - 1;
+    }
+    return o;
+  }
+
+  /** Same as NeighborOffset, but as linear offset inside a block buffer */
+  static std::ptrdiff_t
+  NeighborBlockOffset(unsigned int n)
+  {
+    std::ptrdiff_t offset = 0;
+    for (unsigned int d = 0; d < VDimension; ++d, n /= 3)
+    {
+      offset += (static_cast<std::ptrdiff_t>(n % 3) - 1) * (std::ptrdiff_t{ 1 } << (BlockBits * d));
+    }
+    return offset;
+  }
+
+  void
+  ComputeBlockAndOffset(const IndexType & idx, BlockIdType & block, size_t & offset) const
+  {
+    block = 0;
+    offset = 0;
+    for (unsigned int d = 0; d < VDimension; ++d)
+    {
+      const auto rel = static_cast<size_t>(idx[d] - m_Region.GetIndex(d));
+      block += (rel >> BlockBits) * m_GridStride[d];
+      offset += (rel & (BlockWidth - 1)) << (BlockBits * d);
+    }
+  }
+
+  RegionType         m_Region;
+  SizeType           m_GridSize{};
+  SizeType           m_GridStride{};
+  std::vector<Block> m_Blocks;
+};
+
+} // end namespace itk
+
+#endif // itkSparseBlockGrid_h
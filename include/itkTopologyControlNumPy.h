@@ -0,0 +1,201 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef itkTopologyControlNumPy_h
+#define itkTopologyControlNumPy_h
+
+// Only the Python wrapping uses this header. Without the Python headers on the include path (they are
+// added by itk-module.cmake if ITK_WRAP_PYTHON is on), e.g. in the header tests, it is empty.
+#if defined(__has_include)
+#  if __has_include("Python.h")
+#    define ITK_TOPOLOGY_CONTROL_HAVE_PYTHON
+#  endif
+#endif
+
+#ifdef ITK_TOPOLOGY_CONTROL_HAVE_PYTHON
+
+// Python.h must be included before any standard headers
+#  include "Python.h"
+
+#  include "itkFixTopologyCarveInside.h"
+#  include "itkFixTopologyCarveOutside.h"
+
+#  include <cstring>
+#  include <string>
+
+namespace itk
+{
+/** \class TopologyControlNumPy
+ *
+ * \brief Entry points for the carve filters which work directly on NumPy buffers
+ *
+ * The input and the optional mask are C-contiguous 3D uint8 or bool arrays. Their buffers are imported
+ * into ITK images without copying, and the GIL is released while the filter runs, so several volumes can
+ * be processed concurrently from Python threads. The Python functions added in TopologyControlNumPy.i
+ * return the result as a view of the output image buffer.
+ *
+ * Python observers can not be called while the GIL is released, therefore no progress is reported.
+ *
+ * \ingroup TopologyControl
+ */
+class TopologyControlNumPy
+{
+public:
+  using PixelType = unsigned char;
+  using ImageType = Image<PixelType, 3>;
+  using MaskImageType = Image<unsigned char, 3>;
+
+  /** Run FixTopologyCarveOutside (or FixTopologyCarveInside if carve_inside is true) on the buffer of
+   * 'array', where voxels equal to 'inside_value' are foreground. 'mask' may be None, otherwise it is 0/1.
+   * The spacing is given in ITK order (x, y, z). */
+  static ImageType::Pointer
+  _FixTopology(PyObject *    array,
+               PyObject *    mask,
+               SizeValueType radius,
+               PixelType     inside_value,
+               bool          carve_inside,
+               double        spacing_x,
+               double        spacing_y,
+               double        spacing_z,
+               bool          use_sparse_state,
+               bool          use_vectorized_classification)
+  {
+    BufferView input_view(array, "array");
+    BufferView mask_view(mask == Py_None ? nullptr : mask, "mask");
+
+    ImageType::SpacingType spacing;
+    spacing[0] = spacing_x;
+    spacing[1] = spacing_y;
+    spacing[2] = spacing_z;
+
+    auto input = input_view.Import(spacing);
+    auto mask_image = mask_view.Import(spacing);
+    if (mask_image && mask_image->GetLargestPossibleRegion() != input->GetLargestPossibleRegion())
+    {
+      itkGenericExceptionMacro("The mask must have the same shape as the array");
+    }
+
+    using FilterType = FixTopologyBase<ImageType, ImageType, MaskImageType>;
+    FilterType::Pointer filter;
+    if (carve_inside)
+      filter = FixTopologyCarveInside<ImageType, ImageType, MaskImageType>::New().GetPointer();
+    else
+      filter = FixTopologyCarveOutside<ImageType, ImageType, MaskImageType>::New().GetPointer();
+    filter->SetInput(input);
+    filter->SetMaskImage(mask_image);
+    filter->SetRadius(radius);
+    filter->SetInsideValue(inside_value);
+    filter->SetUseSparseState(use_sparse_state);
+    filter->SetUseVectorizedClassification(use_vectorized_classification);
+
+    // the buffers stay valid while the views are held, the GIL is not needed to run the filter
+    std::string     error;
+    PyThreadState * thread_state = PyEval_SaveThread();
+    try
+    {
+      filter->Update();
+    }
+    catch (const std::exception & e)
+    {
+      error = e.what();
+    }
+    catch (...)
+    {
+      // nothing may propagate while the GIL is released
+      error = "Unknown exception while running the filter";
+    }
+    PyEval_RestoreThread(thread_state);
+
+    if (!error.empty())
+    {
+      itkGenericExceptionMacro(<< error);
+    }
+
+    ImageType::Pointer output = filter->GetOutput();
+    output->DisconnectPipeline();
+    return output;
+  }
+
+private:
+  /** Holds a Py_buffer of a C-contiguous 3D array with 1-byte items (uint8 or bool) */
+  class BufferView
+  {
+  public:
+    BufferView(PyObject * obj, const char * name)
+    {
+      if (!obj)
+        return;
+
+      if (PyObject_GetBuffer(obj, &m_View, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0)
+      {
+        PyErr_Clear();
+        itkGenericExceptionMacro("The " << name << " must support the buffer protocol and be C-contiguous");
+      }
+
+      const char * format = m_View.format ? m_View.format : "B";
+      const bool   is_byte = std::strcmp(format, "B") == 0 || std::strcmp(format, "?") == 0;
+      if (m_View.ndim != 3 || m_View.itemsize != 1 || !is_byte)
+      {
+        // the destructor does not run if the constructor throws
+        PyBuffer_Release(&m_View);
+        itkGenericExceptionMacro("The " << name << " must be a 3D uint8 or bool array");
+      }
+      m_Valid = true;
+    }
+
+    ~BufferView()
+    {
+      if (m_Valid)
+        PyBuffer_Release(&m_View);
+    }
+
+    ITK_DISALLOW_COPY_AND_MOVE(BufferView);
+
+    /** Image sharing the buffer, or nullptr if no object was given.
+     * The NumPy shape (z, y, x) maps to the ITK size (x, y, z). */
+    ImageType::Pointer
+    Import(const ImageType::SpacingType & spacing) const
+    {
+      if (!m_Valid)
+        return nullptr;
+
+      ImageType::SizeType size;
+      for (unsigned int d = 0; d < 3; ++d)
+      {
+        size[d] = static_cast<SizeValueType>(m_View.shape[2 - d]);
+      }
+
+      auto image = ImageType::New();
+      image->SetRegions(size);
+      image->SetSpacing(spacing);
+      image->GetPixelContainer()->SetImportPointer(
+        static_cast<PixelType *>(m_View.buf), static_cast<SizeValueType>(m_View.len), false);
+      return image;
+    }
+
+  private:
+    Py_buffer m_View{};
+    bool      m_Valid = false;
+  };
+};
+
+} // end namespace itk
+
+#endif // ITK_TOPOLOGY_CONTROL_HAVE_PYTHON
+
+#endif // itkTopologyControlNumPy_h
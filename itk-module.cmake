@@ -10,12 +10,28 @@ file(READ "${MY_CURRENT_DIR}/README.md" DOCUMENTATION)
 # By convention those modules outside of ITK are not prefixed with
 # ITK.
 
+# the Python wrapping of the changed voxels and the NumPy entry points use ITKBridgeNumPy, and
+# itkTopologyControlNumPy.h includes Python.h (like itkPyBuffer.h of ITKBridgeNumPy)
+set(_TopologyControl_python_depends)
+if(ITK_WRAP_PYTHON)
+  set(_TopologyControl_python_depends ITKBridgeNumPy)
+  set(TopologyControl_SYSTEM_INCLUDE_DIRS ${Python3_INCLUDE_DIRS})
+endif()
+
+# the TopologyControlBatch command line tool (TopologyControl_BUILD_APPLICATIONS) reads and writes images
+set(_TopologyControl_application_depends)
+if(TopologyControl_BUILD_APPLICATIONS)
+  set(_TopologyControl_application_depends ITKIOImageBase ITKIOMeta ITKIONIFTI ITKIONRRD)
+endif()
+
 # define the dependencies of the include module and the tests
 itk_module(TopologyControl
   DEPENDS
     ITKCommon
     ITKBinaryMathematicalMorphology
     ITKDistanceMap
+    ${_TopologyControl_python_depends}
+    ${_TopologyControl_application_depends}
   COMPILE_DEPENDS
     ITKCommon
   TEST_DEPENDS
@@ -0,0 +1,171 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkFixTopologyCarveOutside.h"
+
+#include "itkImageRegionRange.h"
+#include "itkTestingMacros.h"
+
+#include <algorithm>
+
+namespace
+{
+constexpr unsigned int Dimension = 3;
+using PixelType = int;
+using ImageType = itk::Image<PixelType, Dimension>;
+using MaskType = itk::Image<unsigned char, Dimension>;
+
+/** Mask covering the plane and the hole around center, in the index space of the input */
+MaskType::Pointer
+MakeMask(const ImageType::IndexType & center)
+{
+  MaskType::RegionType region;
+  region.SetIndex({ center[0] - 7, center[1] - 7, center[2] - 2 });
+  region.SetSize({ 15, 15, 5 });
+
+  auto mask = MaskType::New();
+  mask->SetRegions(region);
+  mask->Allocate();
+  mask->FillBuffer(0);
+
+  region.SetIndex(2, center[2]);
+  region.SetSize(2, 1);
+  for (auto & pixel : itk::ImageRegionRange<MaskType>(*mask, region))
+  {
+    pixel = 1;
+  }
+  return mask;
+}
+
+/** Mask covering the plane z = 20 between x0 and x1 */
+MaskType::Pointer
+MakeSlabMask(itk::IndexValueType x0, itk::IndexValueType x1)
+{
+  MaskType::RegionType region;
+  region.SetIndex({ x0, 5, 17 });
+  region.SetSize({ static_cast<itk::SizeValueType>(x1 - x0 + 1), 20, 7 });
+
+  auto mask = MaskType::New();
+  mask->SetRegions(region);
+  mask->Allocate();
+  mask->FillBuffer(0);
+
+  region.SetIndex(2, 20);
+  region.SetSize(2, 1);
+  for (auto & pixel : itk::ImageRegionRange<MaskType>(*mask, region))
+  {
+    pixel = 1;
+  }
+  return mask;
+}
+} // namespace
+
+int
+itkFixTopologyBatchTest(int, char *[])
+{
+  using RangeType = itk::ImageRegionRange<ImageType>;
+
+  // plane with three holes
+  auto image = ImageType::New();
+  image->SetRegions({ 64, 64, 40 });
+  image->Allocate();
+  image->FillBuffer(0);
+
+  ImageType::RegionType region;
+  region.SetIndex({ 0, 0, 20 });
+  region.SetSize({ 64, 64, 1 });
+  for (auto & pixel : RangeType(*image, region))
+  {
+    pixel = 1;
+  }
+
+  const std::vector<ImageType::IndexType> holes = { { 15, 15, 20 }, { 45, 15, 20 }, { 20, 20, 20 } };
+  for (const auto & hole : holes)
+  {
+    region.SetIndex({ hole[0] - 2, hole[1] - 2, 20 });
+    region.SetSize({ 5, 5, 1 });
+    for (auto & pixel : RangeType(*image, region))
+    {
+      pixel = 0;
+    }
+  }
+
+  auto filter = itk::FixTopologyCarveOutside<ImageType, ImageType>::New();
+  filter->SetInput(image);
+  filter->ComputeChangedVoxelsOn();
+
+  // the first and last mask overlap and are carved as one region,
+  // the second one is carved concurrently with them
+  for (const auto & hole : holes)
+  {
+    filter->AddMaskImage(MakeMask(hole));
+  }
+  ITK_TEST_EXPECT_EQUAL(filter->GetNumberOfMaskImages(), 3u);
+
+  ITK_TRY_EXPECT_NO_EXCEPTION(filter->Update());
+
+  auto output = filter->GetOutput();
+  for (const auto & hole : holes)
+  {
+    ITK_TEST_EXPECT_EQUAL(output->GetPixel(hole), 1);
+  }
+
+  // only the holes are closed, nothing else changes
+  ITK_TEST_EXPECT_EQUAL(filter->GetChangedVoxels()->Size(), holes.size() * 25);
+
+  filter->ClearMaskImages();
+  ITK_TEST_EXPECT_EQUAL(filter->GetNumberOfMaskImages(), 0u);
+
+  // a wide hole straddling two overlapping masks: the result must not depend on the order of the masks
+  image->FillBuffer(0);
+  region.SetIndex({ 0, 0, 20 });
+  region.SetSize({ 64, 64, 1 });
+  for (auto & pixel : RangeType(*image, region))
+  {
+    pixel = 1;
+  }
+  region.SetIndex({ 15, 12, 20 });
+  region.SetSize({ 10, 6, 1 });
+  for (auto & pixel : RangeType(*image, region))
+  {
+    pixel = 0;
+  }
+
+  const std::vector<MaskType::Pointer> masks = { MakeSlabMask(10, 21), MakeSlabMask(18, 30) };
+  std::vector<ImageType::Pointer>      outputs;
+  for (const bool reversed : { false, true })
+  {
+    auto ordered = itk::FixTopologyCarveOutside<ImageType, ImageType>::New();
+    ordered->SetInput(image);
+    ordered->ComputeChangedVoxelsOn();
+    ordered->AddMaskImage(masks[reversed ? 1 : 0]);
+    ordered->AddMaskImage(masks[reversed ? 0 : 1]);
+    ITK_TRY_EXPECT_NO_EXCEPTION(ordered->Update());
+
+    // the masks together cover the hole, which is closed
+    ITK_TEST_EXPECT_EQUAL(ordered->GetChangedVoxels()->Size(), region.GetNumberOfPixels());
+    outputs.push_back(ordered->GetOutput());
+  }
+
+  RangeType first(*outputs[0], outputs[0]->GetBufferedRegion());
+  RangeType second(*outputs[1], outputs[1]->GetBufferedRegion());
+  ITK_TEST_EXPECT_TRUE(std::equal(first.begin(), first.end(), second.begin()));
+
+  std::cout << "Test finished." << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,138 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkFixTopologyCarveInside.h"
+#include "itkFixTopologyCarveOutside.h"
+#include "itkFixTopologyTestHelpers.h"
+
+#include "itkImageRegionIndexRange.h"
+#include "itkTestingMacros.h"
+
+#include <algorithm>
+
+namespace
+{
+constexpr unsigned int Dimension = 3;
+using PixelType = int;
+using ImageType = itk::Image<PixelType, Dimension>;
+using MaskType = itk::Image<unsigned char, Dimension>;
+using OffsetListType = std::vector<itk::IdentifierType>;
+
+/** Buffer offsets of all voxels in the region, in increasing order */
+OffsetListType
+Offsets(const ImageType * image, const ImageType::IndexType & index, const ImageType::SizeType & size)
+{
+  OffsetListType offsets;
+  for (const auto & idx : itk::ImageRegionIndexRange<Dimension>(ImageType::RegionType(index, size)))
+  {
+    offsets.push_back(image->ComputeOffset(idx));
+  }
+  return offsets;
+}
+
+/** Changed voxels reported by the filter. They must be the voxels where the output differs from the input,
+ * which is checked for every run. */
+template <typename TFilter>
+OffsetListType
+ChangedVoxels(const ImageType * image, const MaskType * mask, itk::SizeValueType radius, bool sparse)
+{
+  auto filter = TFilter::New();
+  filter->SetInput(image);
+  filter->SetMaskImage(mask);
+  filter->SetRadius(radius);
+  filter->SetUseSparseState(sparse);
+  filter->ComputeChangedVoxelsOn();
+  filter->Update();
+
+  const OffsetListType changed = filter->GetChangedVoxels()->CastToSTLConstContainer();
+  if (changed != TopologyControlTesting::DifferingOffsets<const ImageType *>(image, filter->GetOutput()))
+  {
+    std::cerr << "Changed voxels of " << filter->GetNameOfClass() << " (sparse: " << sparse
+              << ") differ from the voxel-wise difference of input and output" << std::endl;
+    return {};
+  }
+  return changed;
+}
+} // namespace
+
+int
+itkFixTopologyChangedVoxelsTest(int, char *[])
+{
+  using namespace TopologyControlTesting;
+  using CarveOutsideType = itk::FixTopologyCarveOutside<ImageType, ImageType>;
+  using CarveInsideType = itk::FixTopologyCarveInside<ImageType, ImageType>;
+
+  // plane with a 3x3 hole, and a second hole which is outside of the mask
+  auto plane = MakeImage<ImageType>({ 40, 30, 20 });
+  Fill<ImageType>(plane, { 0, 0, 10 }, { 40, 30, 1 }, 1);
+  Fill<ImageType>(plane, { 9, 9, 10 }, { 3, 3, 1 }, 0);
+  Fill<ImageType>(plane, { 29, 19, 10 }, { 3, 3, 1 }, 0);
+
+  auto mask = MakeImage<MaskType>(plane->GetLargestPossibleRegion().GetSize());
+  Fill<MaskType>(mask, { 0, 0, 8 }, { 20, 30, 5 }, 1);
+
+  // only the hole inside the mask is closed
+  const auto hole = Offsets(plane, { 9, 9, 10 }, { 3, 3, 1 });
+  ITK_TEST_EXPECT_TRUE(ChangedVoxels<CarveOutsideType>(plane, mask, 2, false) == hole);
+  ITK_TEST_EXPECT_TRUE(ChangedVoxels<CarveOutsideType>(plane, mask, 2, true) == hole);
+
+  // without mask both holes are closed, offsets are sorted
+  auto both_holes = Offsets(plane, { 29, 19, 10 }, { 3, 3, 1 });
+  both_holes.insert(both_holes.end(), hole.begin(), hole.end());
+  std::sort(both_holes.begin(), both_holes.end());
+  ITK_TEST_EXPECT_TRUE(ChangedVoxels<CarveOutsideType>(plane, nullptr, 2, false) == both_holes);
+  ITK_TEST_EXPECT_TRUE(ChangedVoxels<CarveOutsideType>(plane, nullptr, 2, true) == both_holes);
+
+  // carve inside: two boxes joined by a single voxel, which is removed
+  auto       boxes = MakeBoxesJoinedByBar<ImageType>(1);
+  const auto bridge = Offsets(boxes, { 19, 14, 14 }, { 1, 1, 1 });
+  ITK_TEST_EXPECT_TRUE(ChangedVoxels<CarveInsideType>(boxes, nullptr, 2, false) == bridge);
+  ITK_TEST_EXPECT_TRUE(ChangedVoxels<CarveInsideType>(boxes, nullptr, 2, true) == bridge);
+
+  // both directions on a volume where voxels are added and removed in many places: a slab with holes
+  // (closed from the outside) and tunnels between thick parts (cut from the inside)
+  auto slab = MakeImage<ImageType>({ 36, 32, 24 });
+  Fill<ImageType>(slab, { 2, 2, 8 }, { 32, 28, 3 }, 1);
+  for (itk::IndexValueType x = 5; x < 30; x += 8)
+  {
+    Fill<ImageType>(slab, { x, 5, 8 }, { 3, 3, 3 }, 0);
+    Fill<ImageType>(slab, { x, 14, 4 }, { 5, 5, 14 }, 1);
+    Fill<ImageType>(slab, { x + 2, 16, 11 }, { 1, 1, 7 }, 0);
+  }
+  auto slab_mask = MakeImage<MaskType>(slab->GetLargestPossibleRegion().GetSize());
+  Fill<MaskType>(slab_mask, { 0, 0, 0 }, { 20, 32, 24 }, 1);
+
+  const MaskType * const slab_masks[] = { nullptr, slab_mask.GetPointer() };
+  for (bool sparse : { false, true })
+  {
+    for (const MaskType * mask : slab_masks)
+    {
+      ITK_TEST_EXPECT_TRUE(!ChangedVoxels<CarveOutsideType>(slab, mask, 3, sparse).empty());
+      ITK_TEST_EXPECT_TRUE(!ChangedVoxels<CarveInsideType>(slab, mask, 2, sparse).empty());
+    }
+  }
+
+  // nothing is recorded unless requested
+  auto filter = CarveOutsideType::New();
+  filter->SetInput(plane);
+  filter->Update();
+  ITK_TEST_EXPECT_EQUAL(filter->GetChangedVoxels()->Size(), 0u);
+
+  std::cout << "Test finished." << std::endl;
+  return EXIT_SUCCESS;
+}
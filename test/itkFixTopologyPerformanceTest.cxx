@@ -0,0 +1,146 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkFixTopologyCarveInside.h"
+#include "itkFixTopologyCarveOutside.h"
+#include "itkFixTopologyTestHelpers.h"
+
+#include "itkImageRegionIndexRange.h"
+#include "itkTestingMacros.h"
+#include "itkTimeProbe.h"
+
+#include <cstdlib>
+
+namespace
+{
+constexpr unsigned int Dimension = 3;
+using PixelType = int;
+using ImageType = itk::Image<PixelType, Dimension>;
+
+using TopologyControlTesting::Carve;
+using TopologyControlTesting::Engine;
+
+/** Spherical shell with two holes in a mostly empty volume. Thin structures in large volumes are the case the
+ * optimized paths are meant for: most blocks of the sparse state stay constant. */
+ImageType::Pointer
+MakeShellImage(itk::SizeValueType n, double thickness)
+{
+  auto image = TopologyControlTesting::MakeImage<ImageType>({ n, n, n });
+
+  const double c = 0.5 * n, outer = 0.4 * n, inner = outer - thickness, hole = 0.1 * n;
+  for (const auto & idx : itk::ImageRegionIndexRange<Dimension>(image->GetLargestPossibleRegion()))
+  {
+    const double dx = idx[0] - c, dy = idx[1] - c, dz = idx[2] - c;
+    const double r2 = dx * dx + dy * dy + dz * dz;
+    const bool   in_hole = (dx * dx + dy * dy) < hole * hole;
+    if (r2 <= outer * outer && r2 > inner * inner && !in_hole)
+    {
+      image->SetPixel(idx, 1);
+    }
+  }
+  return image;
+}
+
+/** Minimum runtime of each engine over 'repeats' rounds, after one warm-up round. The engines run interleaved,
+ * so a change of the machine load affects all of them alike. */
+template <typename TFilter>
+std::vector<double>
+TimeCarve(const ImageType * image, const std::vector<Engine> & engines, itk::SizeValueType radius, unsigned repeats)
+{
+  std::vector<itk::TimeProbe> probes(engines.size());
+  for (unsigned round = 0; round <= repeats; ++round)
+  {
+    for (size_t e = 0; e < engines.size(); ++e)
+    {
+      if (round == 0)
+      {
+        Carve<TFilter>(image, engines[e], radius);
+        continue;
+      }
+      probes[e].Start();
+      Carve<TFilter>(image, engines[e], radius);
+      probes[e].Stop();
+    }
+  }
+
+  std::vector<double> times;
+  for (const auto & probe : probes)
+  {
+    times.push_back(probe.GetMinimum());
+  }
+  return times;
+}
+} // namespace
+
+int
+itkFixTopologyPerformanceTest(int argc, char * argv[])
+{
+  if (argc < 3)
+  {
+    std::cerr << "Missing parameters." << std::endl;
+    std::cerr << "Usage: " << itkNameOfTestExecutableMacro(argv);
+    std::cerr << " maxSparseRuntimeRatio maxVectorizedRuntimeRatio";
+    std::cerr << std::endl;
+    return EXIT_FAILURE;
+  }
+  const double max_sparse_ratio = std::atof(argv[1]);
+  const double max_vectorized_ratio = std::atof(argv[2]);
+
+  using CarveOutsideType = itk::FixTopologyCarveOutside<ImageType, ImageType>;
+  using CarveInsideType = itk::FixTopologyCarveInside<ImageType, ImageType>;
+
+  // the reference engine first, the runtime of the others is relative to it
+  std::vector<Engine> engines = { TopologyControlTesting::reference_engine };
+  for (const auto & engine : TopologyControlTesting::alternative_engines)
+  {
+    engines.push_back(engine);
+  }
+
+  const auto shell = MakeShellImage(192, 3.0);
+  const auto outside_times = TimeCarve<CarveOutsideType>(shell, engines, 1, 5);
+  const auto inside_times = TimeCarve<CarveInsideType>(shell, engines, 1, 5);
+  std::cout << "<DartMeasurement name=\"reference_outside_seconds\" type=\"numeric/double\">" << outside_times[0]
+            << "</DartMeasurement>" << std::endl;
+  std::cout << "<DartMeasurement name=\"reference_inside_seconds\" type=\"numeric/double\">" << inside_times[0]
+            << "</DartMeasurement>" << std::endl;
+
+  unsigned num_slow = 0;
+  for (size_t e = 1; e < engines.size(); ++e)
+  {
+    const auto & engine = engines[e];
+    const double max_ratio = engine.vectorized ? max_vectorized_ratio : max_sparse_ratio;
+    const double outside_ratio = outside_times[e] / outside_times[0];
+    const double inside_ratio = inside_times[e] / inside_times[0];
+
+    std::cout << "<DartMeasurement name=\"" << engine.name << "_outside_ratio\" type=\"numeric/double\">"
+              << outside_ratio << "</DartMeasurement>" << std::endl;
+    std::cout << "<DartMeasurement name=\"" << engine.name << "_inside_ratio\" type=\"numeric/double\">"
+              << inside_ratio << "</DartMeasurement>" << std::endl;
+
+    if (outside_ratio > max_ratio || inside_ratio > max_ratio)
+    {
+      std::cerr << "Engine " << engine.name << " is slower than the reference: runtime ratio " << outside_ratio
+                << " (outside), " << inside_ratio << " (inside), threshold " << max_ratio << std::endl;
+      ++num_slow;
+    }
+  }
+  ITK_TEST_EXPECT_EQUAL(num_slow, 0u);
+
+  std::cout << "Test finished." << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,180 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkFixTopologySliceWise.h"
+
+#include "itkImageRegionRange.h"
+#include "itkTestingMacros.h"
+
+namespace
+{
+/** Square of 'width' pixels with a hole of 'hole_size' pixels centered at 'hole', in the xy-plane of each slice */
+template <typename TImage>
+typename TImage::Pointer
+MakeSquareWithHole(const typename TImage::SizeType & size,
+                   itk::SizeValueType                width,
+                   const itk::Index<2> &             hole,
+                   const itk::Size<2> &              hole_size = { { 3, 3 } })
+{
+  using RangeType = itk::ImageRegionRange<TImage>;
+
+  auto image = TImage::New();
+  image->SetRegions(size);
+  image->Allocate();
+  image->FillBuffer(0);
+
+  auto region = image->GetLargestPossibleRegion();
+  region.SetIndex(0, 4);
+  region.SetIndex(1, 4);
+  region.SetSize(0, width);
+  region.SetSize(1, width);
+  for (auto & pixel : RangeType(*image, region))
+  {
+    pixel = 1;
+  }
+
+  for (unsigned int d = 0; d < 2; ++d)
+  {
+    region.SetIndex(d, hole[d] - static_cast<itk::IndexValueType>(hole_size[d] / 2));
+    region.SetSize(d, hole_size[d]);
+  }
+  for (auto & pixel : RangeType(*image, region))
+  {
+    pixel = 0;
+  }
+  return image;
+}
+} // namespace
+
+int
+itkFixTopologySliceWiseTest(int, char *[])
+{
+  using PixelType = int;
+  using Image2DType = itk::Image<PixelType, 2>;
+  using Image3DType = itk::Image<PixelType, 3>;
+
+  // single 2D image
+  {
+    auto filter = itk::FixTopologySliceWise<Image2DType, Image2DType>::New();
+
+    ITK_EXERCISE_BASIC_OBJECT_METHODS(filter, FixTopologySliceWise, FixTopologyMaskInputBase);
+
+    auto image = MakeSquareWithHole<Image2DType>({ 32, 32 }, 20, { 14, 14 });
+    filter->SetInput(image);
+    filter->SetRadius(3);
+    ITK_TRY_EXPECT_NO_EXCEPTION(filter->Update());
+
+    auto output = filter->GetOutput();
+    ITK_TEST_EXPECT_EQUAL(output->GetPixel({ 14, 14 }), 1);
+    ITK_TEST_EXPECT_EQUAL(output->GetPixel({ 1, 1 }), 0);
+
+    // the slice direction is ignored for 2D images
+    filter->SetSliceDirection(5);
+    ITK_TRY_EXPECT_NO_EXCEPTION(filter->Update());
+    ITK_TEST_EXPECT_EQUAL(filter->GetOutput()->GetPixel({ 14, 14 }), 1);
+  }
+
+  // stack of slices, each slice is closed independently
+  {
+    auto filter = itk::FixTopologySliceWise<Image3DType, Image3DType>::New();
+
+    // the hole is 3 pixels wide along y, but 9 pixels along x
+    auto image = MakeSquareWithHole<Image3DType>({ 32, 32, 6 }, 20, { 14, 14 }, { { 9, 3 } });
+    filter->SetInput(image);
+    filter->SetRadius(3);
+    ITK_TEST_SET_GET_VALUE(2u, filter->GetSliceDirection());
+    ITK_TRY_EXPECT_NO_EXCEPTION(filter->Update());
+
+    auto output = filter->GetOutput();
+    for (itk::IndexValueType z = 0; z < 6; ++z)
+    {
+      ITK_TEST_EXPECT_EQUAL(output->GetPixel({ 14, 14, z }), 1);
+      ITK_TEST_EXPECT_EQUAL(output->GetPixel({ 1, 1, z }), 0);
+    }
+
+    // in the xz-slices the hole is a gap of 9 pixels between two bars, which is too wide to be closed
+    filter->SetSliceDirection(1);
+    ITK_TRY_EXPECT_NO_EXCEPTION(filter->Update());
+    for (itk::IndexValueType z = 0; z < 6; ++z)
+    {
+      ITK_TEST_EXPECT_EQUAL(filter->GetOutput()->GetPixel({ 14, 14, z }), 0);
+    }
+
+    filter->SetSliceDirection(3);
+    ITK_TRY_EXPECT_EXCEPTION(filter->Update());
+
+    // a mask which does not cover all slices is rejected, instead of using the default mask for the others
+    using MaskType = itk::Image<unsigned char, 3>;
+    auto mask = MaskType::New();
+    mask->SetRegions(MaskType::RegionType({ 0, 0, 0 }, { 32, 32, 3 }));
+    mask->Allocate();
+    mask->FillBuffer(1);
+    filter->SetSliceDirection(2);
+    filter->SetMaskImage(mask);
+    ITK_TRY_EXPECT_EXCEPTION(filter->Update());
+  }
+
+  // options of the slice filters: batch masks, vectorized classification and changed voxels
+  {
+    using MaskType = itk::Image<unsigned char, 3>;
+
+    auto image = MakeSquareWithHole<Image3DType>({ 32, 32, 6 }, 20, { 14, 14 });
+
+    // the batch mask covers the hole in the slices 1 and 2 only
+    auto mask = MaskType::New();
+    mask->SetRegions(image->GetLargestPossibleRegion());
+    mask->Allocate();
+    mask->FillBuffer(0);
+    for (auto & pixel : itk::ImageRegionRange<MaskType>(*mask, MaskType::RegionType({ 10, 10, 1 }, { 9, 9, 2 })))
+    {
+      pixel = 1;
+    }
+
+    auto filter = itk::FixTopologySliceWise<Image3DType, Image3DType>::New();
+    filter->SetInput(image);
+    filter->SetRadius(3);
+    filter->AddMaskImage(mask);
+    filter->UseVectorizedClassificationOn();
+    filter->ComputeChangedVoxelsOn();
+    ITK_TEST_EXPECT_EQUAL(filter->GetNumberOfMaskImages(), 1u);
+    ITK_TRY_EXPECT_NO_EXCEPTION(filter->Update());
+
+    auto                             output = filter->GetOutput();
+    std::vector<itk::IdentifierType> expected;
+    for (itk::IndexValueType z = 0; z < 6; ++z)
+    {
+      const bool closed = (z == 1 || z == 2);
+      ITK_TEST_EXPECT_EQUAL(output->GetPixel({ 14, 14, z }), closed ? 1 : 0);
+      for (itk::IndexValueType y = 13; closed && y <= 15; ++y)
+      {
+        for (itk::IndexValueType x = 13; x <= 15; ++x)
+        {
+          expected.push_back(output->ComputeOffset({ x, y, z }));
+        }
+      }
+    }
+    ITK_TEST_EXPECT_TRUE(filter->GetChangedVoxels()->CastToSTLConstContainer() == expected);
+
+    filter->UseSparseStateOn();
+    ITK_TRY_EXPECT_NO_EXCEPTION(filter->Update());
+    ITK_TEST_EXPECT_TRUE(filter->GetChangedVoxels()->CastToSTLConstContainer() == expected);
+  }
+
+  std::cout << "Test finished." << std::endl;
+  return EXIT_SUCCESS;
+}
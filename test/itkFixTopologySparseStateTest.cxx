@@ -0,0 +1,139 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkFixTopologyCarveInside.h"
+#include "itkFixTopologyCarveOutside.h"
+#include "itkFixTopologyTestHelpers.h"
+#include "itkSparseBlockGrid.h"
+
+#include "itkTestingMacros.h"
+
+#include <algorithm>
+#include <array>
+
+namespace
+{
+constexpr unsigned int Dimension = 3;
+using PixelType = int;
+using ImageType = itk::Image<PixelType, Dimension>;
+using MaskType = itk::Image<unsigned char, Dimension>;
+
+/** Run the filter with the dense (outputs[0]) and with the sparse state (outputs[1]) */
+template <typename TFilter>
+void
+CarveDenseAndSparse(const ImageType *             image,
+                    const MaskType *              mask,
+                    itk::SizeValueType            radius,
+                    typename ImageType::Pointer * outputs)
+{
+  for (int sparse = 0; sparse < 2; ++sparse)
+  {
+    auto filter = TFilter::New();
+    filter->SetInput(image);
+    filter->SetMaskImage(mask);
+    filter->SetRadius(radius);
+    filter->SetUseSparseState(sparse != 0);
+    filter->Update();
+    outputs[sparse] = filter->GetOutput();
+  }
+}
+} // namespace
+
+int
+itkFixTopologySparseStateTest(int, char *[])
+{
+  using namespace TopologyControlTesting;
+  using CarveOutsideType = itk::FixTopologyCarveOutside<ImageType, ImageType>;
+  using CarveInsideType = itk::FixTopologyCarveInside<ImageType, ImageType>;
+
+  // block grid on a region which is not a multiple of the block size, with a negative start index
+  using GridType = itk::SparseBlockGrid<unsigned char, Dimension>;
+  GridType grid;
+  grid.Initialize(GridType::RegionType({ { -1, -1, -1 } }, { { 20, 17, 9 } }), 0);
+  ITK_TEST_EXPECT_EQUAL(grid.GetNumberOfBlocks(), 3u * 3u * 2u);
+
+  // writing the value of the tile does not allocate the block
+  grid.SetPixel({ { 3, 3, 3 } }, 0);
+  ITK_TEST_EXPECT_EQUAL(grid.GetNumberOfAllocatedBlocks(), 0u);
+
+  // the voxels at x = 6 and 7 lie in different blocks, the neighborhood is gathered across the border
+  grid.SetPixel({ { 6, 6, 6 } }, 1);
+  grid.SetPixel({ { 7, 6, 6 } }, 2);
+  ITK_TEST_EXPECT_EQUAL(grid.GetNumberOfAllocatedBlocks(), 2u);
+  std::array<unsigned char, 27> neighborhood;
+  grid.GetNeighborhood({ { 6, 6, 6 } }, neighborhood);
+  ITK_TEST_EXPECT_EQUAL(static_cast<int>(neighborhood[13]), 1);
+  ITK_TEST_EXPECT_EQUAL(static_cast<int>(neighborhood[14]), 2);
+  ITK_TEST_EXPECT_EQUAL(std::count(neighborhood.begin(), neighborhood.end(), 0), 25);
+
+  // neighbor blocks are clipped to the grid
+  unsigned int num_neighbor_blocks = 0;
+  grid.ForEachNeighborBlock(0, 1, [&num_neighbor_blocks](GridType::BlockIdType) { ++num_neighbor_blocks; });
+  ITK_TEST_EXPECT_EQUAL(num_neighbor_blocks, 7u);
+  num_neighbor_blocks = 0;
+  grid.ForEachNeighborBlock(0, 2, [&num_neighbor_blocks](GridType::BlockIdType) { ++num_neighbor_blocks; });
+  ITK_TEST_EXPECT_EQUAL(num_neighbor_blocks, 17u);
+
+  // plane with a hole, on a grid which is not a multiple of the block size
+  auto plane = MakeImage<ImageType>({ 60, 50, 70 });
+  Fill<ImageType>(plane, { 0, 0, 20 }, { 60, 50, 1 }, 1);
+  Fill<ImageType>(plane, { 28, 23, 20 }, { 5, 5, 1 }, 0);
+  const ImageType::IndexType hole = { 30, 25, 20 };
+  const auto                 plane_size = CountForeground(plane);
+
+  // default mask: the distance map of each slab is computed with the initial margin
+  ImageType::Pointer outputs[2];
+  CarveDenseAndSparse<CarveOutsideType>(plane, nullptr, 3, outputs);
+  ITK_TEST_EXPECT_TRUE(Identical(outputs[0], outputs[1]));
+  ITK_TEST_EXPECT_EQUAL(outputs[1]->GetPixel(hole), 1);
+  ITK_TEST_EXPECT_EQUAL(CountForeground(outputs[1]), plane_size + 25);
+
+  // A thick mask, with anisotropic spacing: the soft voxels far from the plane are further from the
+  // contour than the initial margin, so the slabs of the distance map need to be enlarged.
+  ImageType::SpacingType spacing;
+  spacing[0] = 1.0;
+  spacing[1] = 1.0;
+  spacing[2] = 2.5;
+  plane->SetSpacing(spacing);
+
+  auto mask = MakeImage<MaskType>(plane->GetLargestPossibleRegion().GetSize());
+  mask->SetSpacing(spacing);
+  Fill<MaskType>(mask, { 0, 0, 5 }, { 60, 50, 40 }, 1);
+
+  CarveDenseAndSparse<CarveOutsideType>(plane, mask, 3, outputs);
+  ITK_TEST_EXPECT_TRUE(Identical(outputs[0], outputs[1]));
+  ITK_TEST_EXPECT_EQUAL(outputs[1]->GetPixel(hole), 1);
+  ITK_TEST_EXPECT_EQUAL(outputs[1]->GetPixel({ 30, 25, 25 }), 0);
+  ITK_TEST_EXPECT_EQUAL(CountForeground(outputs[1]), plane_size + 25);
+
+  // carve inside: two boxes connected by a thin bar, the opening cuts the bar. All bar voxels have the
+  // same distance, so the dense and sparse path may cut it at a different voxel.
+  auto       boxes = MakeBoxesJoinedByBar<ImageType>(10);
+  const auto boxes_size = CountForeground(boxes);
+
+  CarveDenseAndSparse<CarveInsideType>(boxes, nullptr, 2, outputs);
+  for (const auto & output : outputs)
+  {
+    ITK_TEST_EXPECT_EQUAL(CountForeground(output), boxes_size - 1);
+    ITK_TEST_EXPECT_EQUAL(output->GetPixel({ 12, 14, 14 }), 1);
+    ITK_TEST_EXPECT_EQUAL(output->GetPixel({ 36, 14, 14 }), 1);
+  }
+
+  std::cout << "Test finished." << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,145 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef itkFixTopologyTestHelpers_h
+#define itkFixTopologyTestHelpers_h
+
+#include "itkImage.h"
+#include "itkImageBufferRange.h"
+#include "itkImageRegionRange.h"
+
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/** Fixtures shared by the TopologyControl tests */
+namespace TopologyControlTesting
+{
+/** Image type of a raw or smart image pointer */
+template <typename TImagePointer>
+using ImageOf =
+  typename std::remove_const<typename std::remove_reference<decltype(*std::declval<TImagePointer>())>::type>::type;
+
+template <typename TImage>
+typename TImage::Pointer
+MakeImage(const typename TImage::SizeType & size)
+{
+  auto image = TImage::New();
+  image->SetRegions(size);
+  image->Allocate();
+  image->FillBuffer(0);
+  return image;
+}
+
+template <typename TImage>
+void
+Fill(TImage * image, const typename TImage::IndexType & index, const typename TImage::SizeType & size, int value)
+{
+  for (auto & pixel : itk::ImageRegionRange<TImage>(*image, typename TImage::RegionType(index, size)))
+  {
+    pixel = value;
+  }
+}
+
+template <typename TImagePointer>
+itk::SizeValueType
+CountForeground(const TImagePointer & image)
+{
+  itk::SizeValueType count = 0;
+  for (auto pixel : itk::ImageBufferRange<const ImageOf<TImagePointer>>(*image))
+  {
+    count += (pixel != 0) ? 1 : 0;
+  }
+  return count;
+}
+
+template <typename TImagePointer>
+bool
+Identical(const TImagePointer & a, const TImagePointer & b)
+{
+  itk::ImageBufferRange<const ImageOf<TImagePointer>> range_a(*a);
+  itk::ImageBufferRange<const ImageOf<TImagePointer>> range_b(*b);
+  return a->GetBufferedRegion() == b->GetBufferedRegion() &&
+         std::equal(range_a.begin(), range_a.end(), range_b.begin());
+}
+
+/** A combination of the optional code paths of FixTopologyBase */
+struct Engine
+{
+  const char * name;
+  bool         sparse;
+  bool         vectorized;
+};
+
+const Engine reference_engine = { "reference", false, false };
+
+const Engine alternative_engines[] = { { "sparse", true, false },
+                                       { "vectorized", false, true },
+                                       { "sparse+vectorized", true, true } };
+
+template <typename TFilter>
+typename TFilter::OutputImageType::Pointer
+Carve(const typename TFilter::InputImageType * image, const Engine & engine, itk::SizeValueType radius)
+{
+  auto filter = TFilter::New();
+  filter->SetInput(image);
+  filter->SetRadius(radius);
+  filter->SetUseSparseState(engine.sparse);
+  filter->SetUseVectorizedClassification(engine.vectorized);
+  filter->Update();
+  return filter->GetOutput();
+}
+
+/** Buffer offsets of the voxels where output differs from input, in increasing order */
+template <typename TImagePointer>
+std::vector<itk::IdentifierType>
+DifferingOffsets(const TImagePointer & input, const TImagePointer & output)
+{
+  itk::ImageBufferRange<const ImageOf<TImagePointer>> input_range(*input);
+  itk::ImageBufferRange<const ImageOf<TImagePointer>> output_range(*output);
+
+  std::vector<itk::IdentifierType> offsets;
+  itk::IdentifierType              offset = 0;
+  for (auto i = input_range.begin(), o = output_range.begin(); o != output_range.end(); ++i, ++o, ++offset)
+  {
+    if (*i != *o)
+    {
+      offsets.push_back(offset);
+    }
+  }
+  return offsets;
+}
+
+/** Two boxes of 15x20x20 voxels, joined by a bar of 'bar_length' voxels along x at y = z = 14. Carving
+ * inside removes a single voxel of the bar. */
+template <typename TImage>
+typename TImage::Pointer
+MakeBoxesJoinedByBar(itk::SizeValueType bar_length)
+{
+  const auto bar_end = static_cast<itk::IndexValueType>(19 + bar_length);
+
+  auto image = MakeImage<TImage>({ { 38 + bar_length, 30, 30 } });
+  Fill<TImage>(image, { { 4, 4, 4 } }, { { 15, 20, 20 } }, 1);
+  Fill<TImage>(image, { { 19, 14, 14 } }, { { bar_length, 1, 1 } }, 1);
+  Fill<TImage>(image, { { bar_end, 4, 4 } }, { { 15, 20, 20 } }, 1);
+  return image;
+}
+} // namespace TopologyControlTesting
+
+#endif // itkFixTopologyTestHelpers_h
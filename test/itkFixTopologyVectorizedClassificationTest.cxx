@@ -0,0 +1,106 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkFixTopologyCarveInside.h"
+#include "itkFixTopologyCarveOutside.h"
+#include "itkFixTopologyTestHelpers.h"
+
+#include "itkTestingMacros.h"
+#include "TopologyInvariantsBatch.h"
+
+#include <random>
+
+namespace
+{
+constexpr unsigned int Dimension = 3;
+using PixelType = int;
+using ImageType = itk::Image<PixelType, Dimension>;
+} // namespace
+
+int
+itkFixTopologyVectorizedClassificationTest(int, char *[])
+{
+  using namespace TopologyControlTesting;
+  using CarveOutsideType = itk::FixTopologyCarveOutside<ImageType, ImageType>;
+  using CarveInsideType = itk::FixTopologyCarveInside<ImageType, ImageType>;
+
+  // the kernel selected for this CPU agrees with the scalar tests, including a partially filled last batch
+  std::mt19937                            rng(1);
+  std::uniform_int_distribution<uint32_t> random_config(0, (uint32_t{ 1 } << 27) - 1);
+  std::vector<uint32_t>                   configs(1001);
+  for (auto & config : configs)
+  {
+    config = random_config(rng);
+  }
+
+  std::vector<uint8_t> removal(configs.size());
+  std::vector<uint8_t> addition(configs.size());
+  topology::ClassifyForegroundRemoval(configs.data(), configs.size(), removal.data());
+  topology::ClassifyForegroundAddition(configs.data(), configs.size(), addition.data());
+
+  size_t mismatches = 0;
+  for (size_t i = 0; i < configs.size(); ++i)
+  {
+    mismatches += (removal[i] != topology::IsSimpleForegroundRemoval(configs[i])) ? 1 : 0;
+    mismatches += (addition[i] != topology::IsSimpleForegroundAddition(configs[i])) ? 1 : 0;
+  }
+  ITK_TEST_EXPECT_EQUAL(mismatches, 0u);
+
+  // carve outside: plane with two holes, which are closed by the dense and the sparse path. The voxels of a hole
+  // have the same distance and are classified in one batch, where each addition changes the configuration of
+  // its neighbors in the batch.
+  auto plane = MakeImage<ImageType>({ 48, 40, 24 });
+  Fill<ImageType>(plane, { 0, 0, 12 }, { 48, 40, 1 }, 1);
+  Fill<ImageType>(plane, { 8, 8, 12 }, { 5, 5, 1 }, 0);
+  Fill<ImageType>(plane, { 30, 20, 12 }, { 3, 3, 1 }, 0);
+  const auto plane_size = CountForeground(plane);
+
+  for (bool sparse : { false, true })
+  {
+    const Engine vectorized = { "vectorized", sparse, true };
+    const Engine scalar = { "scalar", sparse, false };
+
+    auto output = Carve<CarveOutsideType>(plane, vectorized, 3);
+    ITK_TEST_EXPECT_EQUAL(output->GetPixel({ 10, 10, 12 }), 1);
+    ITK_TEST_EXPECT_EQUAL(output->GetPixel({ 31, 21, 12 }), 1);
+    ITK_TEST_EXPECT_EQUAL(CountForeground(output), plane_size + 25 + 9);
+    ITK_TEST_EXPECT_TRUE(Identical(output, Carve<CarveOutsideType>(plane, scalar, 3)));
+  }
+
+  // carve inside: two boxes joined by a bar, which grows from both ends. For an even length the two fronts meet in
+  // one batch, where adding one of the middle voxels outdates the configuration of the other, so exactly one voxel
+  // is removed. Which one depends on the processing order, so only the number is compared with the scalar path.
+  for (itk::SizeValueType bar_length : { 1, 2, 10 })
+  {
+    auto       boxes = MakeBoxesJoinedByBar<ImageType>(bar_length);
+    const auto boxes_size = CountForeground(boxes);
+
+    for (bool sparse : { false, true })
+    {
+      const Engine vectorized = { "vectorized", sparse, true };
+      const Engine scalar = { "scalar", sparse, false };
+
+      auto output = Carve<CarveInsideType>(boxes, vectorized, 1);
+      ITK_TEST_EXPECT_EQUAL(DifferingOffsets<const ImageType *>(boxes, output).size(), 1u);
+      ITK_TEST_EXPECT_EQUAL(CountForeground(Carve<CarveInsideType>(boxes, scalar, 1)), boxes_size - 1);
+    }
+  }
+
+  std::cout << "Test finished." << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,201 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkMultiThreaderBase.h"
+#include "itkTestingMacros.h"
+
+#include "TopologyInvariants.h"
+#include "TopologyInvariants2D.h"
+#include "TopologyInvariantsBatch.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <vector>
+
+namespace
+{
+/** A batched classification kernel of TopologyInvariantsBatch.h */
+struct Kernel
+{
+  const char *                       name;
+  topology::detail::ClassifyFunction classify;
+};
+
+/** Yokoi connectivity number of the center for the 'label' set: sum over the face neighbors x_k of
+ * x_k - x_k * x_k+1 * x_k+2, in cyclic order around the center. With 'complement' the set of the other
+ * label is counted instead, which gives the 8-connectivity number. */
+template <typename TNeighborhood>
+int
+YokoiNumber(const TNeighborhood & vals, unsigned char label, bool complement)
+{
+  static constexpr unsigned cycle[8] = { 5, 2, 1, 0, 3, 6, 7, 8 };
+
+  int x[8];
+  for (unsigned k = 0; k < 8; ++k)
+  {
+    x[k] = ((vals[cycle[k]] == label) != complement) ? 1 : 0;
+  }
+
+  int number = 0;
+  for (unsigned k = 0; k < 8; k += 2)
+  {
+    number += x[k] - x[k] * x[(k + 1) % 8] * x[(k + 2) % 8];
+  }
+  return number;
+}
+} // namespace
+
+// Compare the bitwise and batched simple point tests with the reference tests of TopologyInvariants.h
+// on all 2^26 configurations of the 3x3x3 neighborhood (the center is implied), for each kernel the
+// CPU supports. The 2D table is compared with the Yokoi connectivity numbers on all 256 configurations.
+int
+itkTopologyInvariantsExhaustiveTest(int argc, char * argv[])
+{
+  // a stride > 1 only tests every stride-th configuration (for quick local runs)
+  const uint32_t stride = (argc > 1) ? static_cast<uint32_t>(std::max(1, std::atoi(argv[1]))) : 1;
+
+  // all kernels, not only the one selected at runtime
+  std::vector<Kernel> kernels = { { "scalar", &topology::detail::ClassifyScalar } };
+#if ITK_TOPOLOGY_HAVE_VECTOR_EXTENSIONS
+  kernels.push_back({ "SSE2", &topology::detail::ClassifySSE2 });
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+  {
+    kernels.push_back({ "AVX2", &topology::detail::ClassifyAVX2 });
+  }
+#endif
+
+  constexpr uint32_t num_configs = uint32_t{ 1 } << 26;
+  constexpr uint32_t chunk_size = uint32_t{ 1 } << 16;
+  constexpr uint32_t num_chunks = num_configs / chunk_size;
+  constexpr unsigned center = 27 / 2;
+
+  std::atomic<uint64_t>              num_tested(0);
+  std::atomic<uint64_t>              num_simple_removal(0);
+  std::atomic<uint64_t>              num_simple_addition(0);
+  std::atomic<uint64_t>              num_mismatches(0);
+  std::vector<std::atomic<uint64_t>> num_kernel_mismatches(kernels.size());
+
+  itk::MultiThreaderBase::New()->ParallelizeArray(
+    0,
+    num_chunks,
+    [&](itk::SizeValueType chunk) {
+      std::vector<uint32_t> configs;
+      configs.reserve(chunk_size);
+      for (uint32_t c = static_cast<uint32_t>(chunk) * chunk_size, end = c + chunk_size; c < end; ++c)
+      {
+        if (c % stride == 0)
+        {
+          // insert a zero center bit
+          configs.push_back((c & ((uint32_t{ 1 } << center) - 1)) | ((c >> center) << (center + 1)));
+        }
+      }
+
+      std::vector<std::vector<uint8_t>> removal(kernels.size(), std::vector<uint8_t>(configs.size()));
+      std::vector<std::vector<uint8_t>> addition(kernels.size(), std::vector<uint8_t>(configs.size()));
+      for (size_t k = 0; k < kernels.size(); ++k)
+      {
+        kernels[k].classify(configs.data(), configs.size(), removal[k].data(), true);
+        kernels[k].classify(configs.data(), configs.size(), addition[k].data(), false);
+      }
+
+      uint64_t                      simple_removal = 0;
+      uint64_t                      simple_addition = 0;
+      uint64_t                      mismatches = 0;
+      std::vector<uint64_t>         kernel_mismatches(kernels.size(), 0);
+      std::array<unsigned char, 27> vals;
+      for (size_t i = 0; i < configs.size(); ++i)
+      {
+        for (unsigned n = 0; n < 27; ++n)
+        {
+          vals[n] = (configs[i] >> n) & 1;
+        }
+
+        // carve outside: remove the center from the foreground
+        vals[center] = 1;
+        const bool ref_removal =
+          topology::EulerInvariant(vals, 1) && topology::CCInvariant(vals, 1) && topology::CCInvariant(vals, 0);
+
+        // carve inside: add the center to the (hard) foreground
+        vals[center] = 0;
+        const bool ref_addition = topology::EulerInvariant(vals, 0) && topology::CCInvariant(vals, 0);
+
+        for (size_t k = 0; k < kernels.size(); ++k)
+        {
+          kernel_mismatches[k] += (ref_removal != (removal[k][i] != 0)) ? 1 : 0;
+          kernel_mismatches[k] += (ref_addition != (addition[k][i] != 0)) ? 1 : 0;
+        }
+        mismatches += (ref_removal != topology::IsSimpleForegroundRemoval(configs[i])) ? 1 : 0;
+        mismatches += (ref_addition != topology::IsSimpleForegroundAddition(configs[i])) ? 1 : 0;
+        simple_removal += ref_removal ? 1 : 0;
+        simple_addition += ref_addition ? 1 : 0;
+      }
+
+      num_tested += configs.size();
+      num_simple_removal += simple_removal;
+      num_simple_addition += simple_addition;
+      num_mismatches += mismatches;
+      for (size_t k = 0; k < kernels.size(); ++k)
+      {
+        num_kernel_mismatches[k] += kernel_mismatches[k];
+      }
+    },
+    nullptr);
+
+  std::cout << "Tested " << num_tested << " configurations, " << num_simple_removal << " simple for removal, "
+            << num_simple_addition << " simple for addition" << std::endl;
+  ITK_TEST_EXPECT_EQUAL(num_tested.load(), (num_configs + stride - 1) / stride);
+  ITK_TEST_EXPECT_EQUAL(num_mismatches.load(), 0u);
+  for (size_t k = 0; k < kernels.size(); ++k)
+  {
+    std::cout << "Kernel " << kernels[k].name << ": " << num_kernel_mismatches[k] << " mismatches" << std::endl;
+    ITK_TEST_EXPECT_EQUAL(num_kernel_mismatches[k].load(), 0u);
+  }
+
+  // 2D table against the Yokoi numbers: the center can be removed if the 4-connectivity number (which counts
+  // the same cells as EulerInvariant2D) and the 8-connectivity number of the foreground are 1, and added if
+  // the 4-connectivity number of the background is 1
+  const auto & table = topology::SimplePointTable2D();
+  unsigned     mismatches_2d = 0;
+  unsigned     simple_removal_2d = 0;
+  unsigned     simple_addition_2d = 0;
+  for (unsigned config = 0; config < 256; ++config)
+  {
+    std::array<unsigned char, 9> vals;
+    for (unsigned n = 0, k = 0; n < 9; ++n)
+    {
+      vals[n] = (n == 9 / 2) ? 1 : static_cast<unsigned char>((config >> k++) & 1);
+    }
+    const bool removal = YokoiNumber(vals, 1, false) == 1 && YokoiNumber(vals, 1, true) == 1;
+    const bool addition = YokoiNumber(vals, 0, false) == 1;
+
+    mismatches_2d += (removal != ((table[config] & topology::kSimpleRemoval) != 0)) ? 1 : 0;
+    mismatches_2d += (addition != ((table[config] & topology::kSimpleAddition) != 0)) ? 1 : 0;
+    mismatches_2d += (topology::PackNeighborhood2D(vals, 1) != config) ? 1 : 0;
+    simple_removal_2d += removal ? 1 : 0;
+    simple_addition_2d += addition ? 1 : 0;
+  }
+  ITK_TEST_EXPECT_EQUAL(mismatches_2d, 0u);
+  ITK_TEST_EXPECT_EQUAL(simple_removal_2d, 48u);
+  ITK_TEST_EXPECT_EQUAL(simple_addition_2d, 116u);
+
+  std::cout << "Test finished." << std::endl;
+  return EXIT_SUCCESS;
+}
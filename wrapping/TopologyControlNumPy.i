@@ -0,0 +1,45 @@
+
+%extend itkTopologyControlNumPy {
+  %pythoncode %{
+
+    @staticmethod
+    def _fix_topology(array, mask, radius, inside_value, carve_inside, spacing, use_sparse_state, use_vectorized_classification):
+        import numpy as np
+        import itk
+
+        if getattr(array, "dtype", None) == np.bool_ and inside_value != 1:
+            raise ValueError("The inside_value of a bool array must be 1 (True)")
+        if not 0 <= inside_value <= 255:
+            raise ValueError("The inside_value must be a uint8 value")
+
+        sz, sy, sx = (1.0, 1.0, 1.0) if spacing is None else spacing
+        image = itkTopologyControlNumPy._FixTopology(
+            array, mask, radius, inside_value, carve_inside, sx, sy, sz, use_sparse_state, use_vectorized_classification
+        )
+        result = itk.array_view_from_image(image)
+        if getattr(array, "dtype", None) == np.bool_:
+            result = result.view(np.bool_)
+        return result
+
+    @staticmethod
+    def carve_outside(array, mask=None, radius=1, inside_value=1, spacing=None, use_sparse_state=False, use_vectorized_classification=False):
+        """Close holes like fix_topology_carve_outside, without copying the NumPy input.
+
+        array and mask are C-contiguous 3D uint8 or bool arrays (z, y, x). Voxels of array equal to
+        inside_value are foreground, which must be 1 for bool arrays. The mask is 0/1 (False/True),
+        whatever inside_value is. spacing is given in the same (z, y, x) order. The GIL is released
+        while the filter runs, so calls from several Python threads run in parallel. Returns a view of
+        the result buffer, with the dtype of array, holding inside_value for foreground and 0 elsewhere.
+        """
+        return itkTopologyControlNumPy._fix_topology(
+            array, mask, radius, inside_value, False, spacing, use_sparse_state, use_vectorized_classification
+        )
+
+    @staticmethod
+    def carve_inside(array, mask=None, radius=1, inside_value=1, spacing=None, use_sparse_state=False, use_vectorized_classification=False):
+        """Open like fix_topology_carve_inside, without copying the NumPy input (see carve_outside)."""
+        return itkTopologyControlNumPy._fix_topology(
+            array, mask, radius, inside_value, True, spacing, use_sparse_state, use_vectorized_classification
+        )
+  %}
+}
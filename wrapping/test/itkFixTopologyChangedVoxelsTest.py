@@ -0,0 +1,45 @@
+# ==========================================================================
+#
+#   Copyright NumFOCUS
+#
+#   Licensed under the Apache License, Version 2.0 (the "License");
+#   you may not use this file except in compliance with the License.
+#   You may obtain a copy of the License at
+#
+#          https://www.apache.org/licenses/LICENSE-2.0.txt
+#
+#   Unless required by applicable law or agreed to in writing, software
+#   distributed under the License is distributed on an "AS IS" BASIS,
+#   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#   See the License for the specific language governing permissions and
+#   limitations under the License.
+#
+# ==========================================================================
+
+import itk
+import numpy as np
+
+# plane with two 3x3 holes, (z, y, x) order
+array = np.zeros((20, 30, 40), dtype=np.uint8)
+array[10, :, :] = 1
+array[10, 9:12, 9:12] = 0
+array[10, 19:22, 29:32] = 0
+image = itk.image_view_from_array(array)
+
+ImageType = type(image)
+MaskType = itk.Image[itk.UC, 3]
+
+carve = itk.FixTopologyCarveOutside[ImageType, ImageType, MaskType].New()
+carve.SetInput(image)
+carve.SetRadius(2)
+carve.ComputeChangedVoxelsOn()
+carve.Update()
+
+output = itk.array_view_from_image(carve.GetOutput())
+changed = itk.array_view_from_vector_container(carve.GetChangedVoxels())
+
+# flat indices into the C-ordered output array, in increasing order
+expected = np.flatnonzero(output != array)
+assert expected.size == 18
+assert np.array_equal(changed, expected)
+assert np.all(output.ravel()[changed] == 1)
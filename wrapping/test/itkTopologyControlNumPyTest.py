@@ -0,0 +1,78 @@
+# ==========================================================================
+#
+#   Copyright NumFOCUS
+#
+#   Licensed under the Apache License, Version 2.0 (the "License");
+#   you may not use this file except in compliance with the License.
+#   You may obtain a copy of the License at
+#
+#          https://www.apache.org/licenses/LICENSE-2.0.txt
+#
+#   Unless required by applicable law or agreed to in writing, software
+#   distributed under the License is distributed on an "AS IS" BASIS,
+#   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#   See the License for the specific language governing permissions and
+#   limitations under the License.
+#
+# ==========================================================================
+
+from concurrent.futures import ThreadPoolExecutor
+
+import itk
+import numpy as np
+
+
+def plane_with_hole(z):
+    """Plane at height z with a 3x3 hole, (z, y, x) order"""
+    array = np.zeros((20, 30, 40), dtype=np.uint8)
+    array[z, :, :] = 1
+    array[z, 9:12, 9:12] = 0
+    return array
+
+
+array = plane_with_hole(10)
+original = array.copy()
+
+# the result is a view of the output buffer, the input is neither copied into nor modified
+closed = itk.TopologyControlNumPy.carve_outside(array, radius=2)
+assert closed.dtype == np.uint8
+assert not closed.flags.owndata
+assert not np.shares_memory(closed, array)
+assert np.array_equal(array, original)
+assert np.all(closed[10, 9:12, 9:12] == 1)
+assert np.count_nonzero(closed) == np.count_nonzero(array) + 9
+
+# the input buffer is used as is, so it must be C-contiguous
+try:
+    itk.TopologyControlNumPy.carve_outside(np.asfortranarray(array), radius=2)
+    raise AssertionError("a Fortran ordered array was accepted")
+except RuntimeError:
+    pass
+
+# bool arrays round-trip as bool, with the same result
+closed_bool = itk.TopologyControlNumPy.carve_outside(array.astype(bool), radius=2)
+assert closed_bool.dtype == np.bool_
+assert np.array_equal(closed_bool, closed.astype(bool))
+
+# other foreground labels, the result holds the label and 0
+labeled = np.where(array == 1, 255, 2).astype(np.uint8)
+closed_labeled = itk.TopologyControlNumPy.carve_outside(labeled, radius=2, inside_value=255)
+assert np.array_equal(closed_labeled, closed * 255)
+try:
+    itk.TopologyControlNumPy.carve_outside(array.astype(bool), radius=2, inside_value=255)
+    raise AssertionError("a bool array with inside_value 255 was accepted")
+except ValueError:
+    pass
+
+# a mask which excludes the hole
+mask = np.zeros_like(array, dtype=bool)
+mask[8:13, :, 20:] = True
+assert np.array_equal(itk.TopologyControlNumPy.carve_outside(array, mask=mask, radius=2), array)
+
+# two threads process different volumes concurrently, with the same results as sequential calls
+arrays = [plane_with_hole(z) for z in (5, 14)]
+expected = [np.array(itk.TopologyControlNumPy.carve_outside(a, radius=2)) for a in arrays]
+with ThreadPoolExecutor(2) as pool:
+    results = list(pool.map(lambda a: itk.TopologyControlNumPy.carve_outside(a, radius=2), arrays))
+for result, reference in zip(results, expected):
+    assert np.array_equal(result, reference)